@@ -1,39 +1,24 @@
 #include "../AppendBuffer/AppendBuffer.h"
 
-AppendBuffer::AppendBuffer() : contents(nullptr), length{0} {}
+AppendBuffer::AppendBuffer(std::pmr::memory_resource* resource)
+    : contents(resource) {}
 
-AppendBuffer::~AppendBuffer() {
-  free(contents);
+void AppendBuffer::flush(int file_descriptor) {
+  write(file_descriptor, contents.data(), contents.length());
 }
 
-void AppendBuffer::flush() {
-  write(STDOUT_FILENO, contents, length);
-}
-
-void AppendBuffer::append(const std::string& text) {
-  char* memory = (char*)realloc(contents, length + text.length());
-
-  if (memory == nullptr) {
-    throw std::runtime_error{
-        "append: could not realloc memory for append buffer"};
-  }
-
-  std::memcpy(&memory[length], text.c_str(), text.length());
-
-  contents = memory;
-  length += text.length();
+void AppendBuffer::append(std::string_view text) {
+  contents.append(text);
 }
 
 void AppendBuffer::clear() {
-  free(contents);
-  contents = nullptr;
-  length = 0;
+  contents.clear();
 }
 
-const int& AppendBuffer::get_length() const {
-  return length;
+std::size_t AppendBuffer::get_length() const {
+  return contents.length();
 }
 
 const char* AppendBuffer::get_contents() const {
-  return contents;
+  return contents.data();
 }
@@ -2,26 +2,29 @@
 #define APPEND_BUFFER_H
 
 #include <string>
+#include <string_view>
+#include <memory_resource>
 #include <stdlib.h>
 #include <unistd.h>
 #include <memory>
 #include <cstring>
 
+// Collects a frame's output so that it is written in one go. The memory is
+// kept between frames, which are all about the same size.
 class AppendBuffer {
 public:
-  AppendBuffer();
-  ~AppendBuffer();
+  AppendBuffer(
+      std::pmr::memory_resource* resource = std::pmr::get_default_resource());
 
-  void flush();
-  void append(const std::string& text);
+  void flush(int file_descriptor);
+  void append(std::string_view text);
   void clear();
 
-  const int& get_length() const;
+  std::size_t get_length() const;
   const char* get_contents() const;
 
 private:
-  char* contents{nullptr};
-  int length{0};
+  std::pmr::string contents;
 };
 
 #endif // !APPEND_BUFFER_H
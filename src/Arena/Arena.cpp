@@ -0,0 +1,105 @@
+#include "Arena.h"
+
+static std::size_t size_class_of(std::size_t bytes) {
+  std::size_t size_class = 0;
+
+  while (((std::size_t)1 << (size_class + ARENA_MIN_BLOCK_SHIFT)) < bytes) {
+    size_class++;
+  }
+
+  return size_class;
+}
+
+static std::size_t block_size_of(std::size_t size_class) {
+  return (std::size_t)1 << (size_class + ARENA_MIN_BLOCK_SHIFT);
+}
+
+Arena::Arena() {}
+
+Arena::~Arena() {
+  release_unused();
+}
+
+// Returns cached blocks to the system, e.g. after buffers were evicted
+void Arena::release_unused() {
+  std::lock_guard<std::mutex> lock{mutex};
+
+  for (std::size_t size_class = 0; size_class < ARENA_SIZE_CLASS_COUNT;
+       size_class++) {
+    for (void* block : free_blocks[size_class]) {
+      ::operator delete(block, std::align_val_t{ARENA_BLOCK_ALIGNMENT});
+      bytes_reserved -= block_size_of(size_class);
+    }
+
+    free_blocks[size_class].clear();
+    free_blocks[size_class].shrink_to_fit();
+  }
+}
+
+std::size_t Arena::get_bytes_in_use() const {
+  std::lock_guard<std::mutex> lock{mutex};
+  return bytes_in_use;
+}
+
+std::size_t Arena::get_bytes_reserved() const {
+  std::lock_guard<std::mutex> lock{mutex};
+  return bytes_reserved;
+}
+
+void* Arena::do_allocate(std::size_t bytes, std::size_t alignment) {
+  if (alignment > ARENA_BLOCK_ALIGNMENT) {
+    throw std::bad_alloc{};
+  }
+
+  if (bytes > ARENA_MAX_CACHED_BLOCK_SIZE) {
+    void* block =
+        ::operator new(bytes, std::align_val_t{ARENA_BLOCK_ALIGNMENT});
+
+    std::lock_guard<std::mutex> lock{mutex};
+    bytes_in_use += bytes;
+    bytes_reserved += bytes;
+    return block;
+  }
+
+  std::size_t size_class = size_class_of(bytes);
+
+  if (size_class >= ARENA_SIZE_CLASS_COUNT) {
+    throw std::bad_alloc{};
+  }
+
+  std::lock_guard<std::mutex> lock{mutex};
+  bytes_in_use += block_size_of(size_class);
+
+  if (!free_blocks[size_class].empty()) {
+    void* block = free_blocks[size_class].back();
+    free_blocks[size_class].pop_back();
+    return block;
+  }
+
+  bytes_reserved += block_size_of(size_class);
+
+  return ::operator new(block_size_of(size_class),
+                        std::align_val_t{ARENA_BLOCK_ALIGNMENT});
+}
+
+void Arena::do_deallocate(void* block, std::size_t bytes, std::size_t) {
+  if (bytes > ARENA_MAX_CACHED_BLOCK_SIZE) {
+    ::operator delete(block, std::align_val_t{ARENA_BLOCK_ALIGNMENT});
+
+    std::lock_guard<std::mutex> lock{mutex};
+    bytes_in_use -= bytes;
+    bytes_reserved -= bytes;
+    return;
+  }
+
+  std::size_t size_class = size_class_of(bytes);
+
+  std::lock_guard<std::mutex> lock{mutex};
+  bytes_in_use -= block_size_of(size_class);
+  free_blocks[size_class].push_back(block);
+}
+
+bool Arena::do_is_equal(const std::pmr::memory_resource& other) const
+    noexcept {
+  return this == &other;
+}
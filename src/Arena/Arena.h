@@ -0,0 +1,46 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <memory_resource>
+#include <vector>
+#include <mutex>
+#include <new>
+#include <cstddef>
+
+// Smallest block handed out, every request is rounded up to a power of two
+#define ARENA_MIN_BLOCK_SHIFT 12
+#define ARENA_SIZE_CLASS_COUNT 48
+// Blocks are page aligned, which covers every alignment a pool asks for
+#define ARENA_BLOCK_ALIGNMENT 4096
+// Larger blocks, such as a file's contents or its line table, are allocated
+// at their exact size and never cached, rounding them up to a power of two
+// could waste almost half of them
+#define ARENA_MAX_CACHED_BLOCK_SIZE ((std::size_t)1 << 20)
+
+// Memory shared by every buffer. Buffers allocate from their own pool on top
+// of the arena and hand whole blocks back when they are closed or evicted;
+// freed blocks are kept for reuse by other buffers until release_unused().
+class Arena : public std::pmr::memory_resource {
+public:
+  Arena();
+  ~Arena();
+
+  void release_unused();
+
+  std::size_t get_bytes_in_use() const;
+  std::size_t get_bytes_reserved() const;
+
+private:
+  mutable std::mutex mutex;
+  std::vector<void*> free_blocks[ARENA_SIZE_CLASS_COUNT];
+  std::size_t bytes_in_use{0};
+  std::size_t bytes_reserved{0};
+
+  void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+  void do_deallocate(void* block, std::size_t bytes,
+                     std::size_t alignment) override;
+  bool do_is_equal(const std::pmr::memory_resource& other) const
+      noexcept override;
+};
+
+#endif // !ARENA_H
@@ -0,0 +1,472 @@
+#include "Buffer.h"
+
+static FileStamp make_file_stamp(int result, const struct stat& file_stat) {
+  if (result == -1) {
+    return FileStamp{};
+  }
+
+  return FileStamp{true, file_stat.st_dev, file_stat.st_ino, file_stat.st_size,
+                   file_stat.st_mtim};
+}
+
+bool FileStamp::operator==(const FileStamp& other) const {
+  return exists == other.exists && device == other.device &&
+         inode == other.inode && size == other.size &&
+         modified.tv_sec == other.modified.tv_sec &&
+         modified.tv_nsec == other.modified.tv_nsec;
+}
+
+SearchResults::SearchResults(std::pmr::memory_resource* upstream)
+    : arena(upstream), occurences(&arena) {}
+
+Buffer::Buffer(const std::string& filename, std::pmr::memory_resource* arena,
+               MemoryAccount* account, std::pmr::memory_resource* file_memory,
+               std::pmr::memory_resource* render_memory)
+    : pool(arena), line_memory(account, &pool), file_memory(file_memory),
+      lines(&line_memory, file_memory), filename(filename),
+      rendered_lines(render_memory) {}
+
+Buffer::~Buffer() {
+  if (file_descriptor != -1) {
+    close(file_descriptor);
+  }
+}
+
+// Opens the file on the UI thread, so that a missing file is reported right
+// away. Returns whether its lines still have to be read.
+bool Buffer::begin_load() {
+  if (loaded || loading) {
+    return false;
+  }
+
+  if (filename.length() == 0) {
+    loaded = true;
+    edits_count = 0;
+    return false;
+  }
+
+  // Kept open so that saving can copy unmodified spans straight from it
+  file_descriptor = ::open(filename.c_str(), O_RDONLY);
+
+  if (file_descriptor == -1) {
+    throw std::runtime_error{"load: could not open file " + filename};
+  }
+
+  struct stat file_stat;
+  disk_stamp = make_file_stamp(fstat(file_descriptor, &file_stat), file_stat);
+  changed_on_disk = false;
+
+  // Binary files are read row by row as they are shown, there are no lines
+  // to read. Whether a file is binary is only guessed once, switching views
+  // later is up to the user.
+  if (!binary_checked) {
+    hex_mode = is_binary_file(file_descriptor);
+    binary_checked = true;
+  }
+
+  if (hex_mode) {
+    try {
+      hex_view = std::make_shared<const HexView>(file_descriptor);
+    } catch (const std::runtime_error&) {
+      close(file_descriptor);
+      file_descriptor = -1;
+      throw std::runtime_error{"load: could not read file " + filename};
+    }
+
+    loaded = true;
+    edits_count = 0;
+    return false;
+  }
+
+  loading = true;
+  return true;
+}
+
+// Runs on a worker thread. The lines are read into a store of their own and
+// only swapped in by finish_load().
+std::shared_ptr<LineStore> Buffer::read_lines() {
+  std::shared_ptr<LineStore> loaded_lines =
+      std::make_shared<LineStore>(&line_memory, file_memory);
+
+  try {
+    loaded_lines->read(file_descriptor);
+  } catch (const std::runtime_error&) {
+    throw std::runtime_error{"load: could not read file " + filename};
+  }
+
+  return loaded_lines;
+}
+
+void Buffer::finish_load(std::shared_ptr<LineStore> loaded_lines) {
+  lines.swap(*loaded_lines);
+  loaded_lines = nullptr;
+
+  if (cursor_position.y > (int)lines.size()) {
+    cursor_position = CursorPosition{0, (int)lines.size()};
+  }
+
+  loading = false;
+  loaded = true;
+  edits_count = 0;
+}
+
+void Buffer::abort_load() {
+  if (file_descriptor != -1) {
+    close(file_descriptor);
+    file_descriptor = -1;
+  }
+
+  loading = false;
+}
+
+// Fills a buffer that has no file, e.g. with the output of a command
+void Buffer::load_scratch(const std::string& name,
+                          const std::vector<std::string>& contents) {
+  unload();
+
+  for (const std::string& line : contents) {
+    lines.insert(lines.size(), line);
+  }
+
+  scratch_name = name;
+  cursor_position = CursorPosition{0, 0};
+  vertical_scroll_offset = 0;
+  horizontal_scroll_offset = 0;
+  loaded = true;
+}
+
+// Drops the contents of the buffer, including its edits. No task may refer to
+// the buffer anymore.
+void Buffer::unload() {
+  lines.clear();
+  hex_view = nullptr;
+  search_results = nullptr;
+  current_occurence_index = 0;
+  rendered_lines.clear();
+
+  if (file_descriptor != -1) {
+    close(file_descriptor);
+    file_descriptor = -1;
+  }
+
+  loaded = false;
+  edits_count = 0;
+  changed_on_disk = false;
+}
+
+// Drops the contents of an unmodified buffer, they are re-read from disk the
+// next time it is viewed. Buffers without a file have nothing to re-read.
+void Buffer::evict() {
+  if (!loaded || is_modified() || pending_tasks > 0 || filename.empty()) {
+    return;
+  }
+
+  unload();
+}
+
+// Shows an unmodified buffer as hex from now on, dropping its lines
+void Buffer::enter_hex_view() {
+  if (file_descriptor == -1) {
+    throw std::runtime_error{"hex: buffer has no file"};
+  }
+
+  hex_view = std::make_shared<const HexView>(file_descriptor);
+  hex_mode = true;
+  lines.clear();
+  search_results = nullptr;
+  current_occurence_index = 0;
+  rendered_lines.clear();
+}
+
+// Goes back to lines, which have to be loaded again
+void Buffer::leave_hex_view() {
+  hex_view = nullptr;
+  hex_mode = false;
+  loaded = false;
+
+  if (file_descriptor != -1) {
+    close(file_descriptor);
+    file_descriptor = -1;
+  }
+}
+
+// Takes the snapshot that write_lines() saves
+LineSnapshot Buffer::begin_save(std::pmr::memory_resource* snapshot_resource) {
+  saving = true;
+  return lines.snapshot(snapshot_resource);
+}
+
+// Runs on a worker thread, reading only the snapshot and its own duplicate of
+// the buffer's file descriptor, which it closes. Long unmodified spans are
+// copied from that descriptor only while its file still matches the stamp
+// taken when the lines were read, and never into a file written in place,
+// which may be the source itself; everything else is written from memory.
+SaveStatistics Buffer::write_lines(const std::string& filename,
+                                   const LineSnapshot& lines, int source_fd,
+                                   const FileStamp& source_stamp) {
+  struct SourceCloser {
+    int file_descriptor;
+
+    ~SourceCloser() {
+      if (file_descriptor != -1) {
+        close(file_descriptor);
+      }
+    }
+  } source_closer{source_fd};
+
+  FileWriter file{filename};
+  struct stat source_stat;
+
+  if (source_fd != -1 &&
+      (file.is_in_place() ||
+       !(make_file_stamp(fstat(source_fd, &source_stat), source_stat) ==
+         source_stamp))) {
+    close(source_fd);
+    source_fd = -1;
+    source_closer.file_descriptor = -1;
+  }
+
+  unsigned int i = 0;
+
+  while (i < lines.size()) {
+    if (source_fd == -1 || lines.is_modified(i)) {
+      file.write(lines[i]);
+      file.write("\n");
+      i++;
+      continue;
+    }
+
+    // Extend the span over following lines that are still contiguous on
+    // disk, so the whole run can be copied in one go
+    unsigned int span_end = i;
+    off_t span_start = lines.get_offset(i);
+    off_t next_offset = span_start + lines[i].length() + 1;
+
+    while (span_end + 1 < lines.size() && !lines.is_modified(span_end + 1) &&
+           lines.get_offset(span_end + 1) == next_offset) {
+      span_end++;
+      next_offset += lines[span_end].length() + 1;
+    }
+
+    // Reordered lines leave many short spans, which are already in memory
+    if (next_offset - span_start < BUFFER_MIN_COPIED_SPAN) {
+      for (; i <= span_end; i++) {
+        file.write(lines[i]);
+        file.write("\n");
+      }
+
+      continue;
+    }
+
+    // The last line on disk may lack its trailing newline
+    off_t span_length = std::min(next_offset, source_stamp.size) - span_start;
+
+    file.copy_range(source_fd, span_start, span_length);
+
+    if (span_start + span_length < next_offset) {
+      file.write("\n");
+    }
+
+    i = span_end + 1;
+  }
+
+  file.commit();
+
+  return SaveStatistics{file.get_offset(), file.get_copied_bytes()};
+}
+
+// Unmodified lines now refer to the file that was just written, unless the
+// lines changed while they were being saved. The buffer then stays modified,
+// and its unmodified lines keep referring to the contents read from the
+// replaced file. Its descriptor is closed, since the file may have been
+// written in place, so the next save writes every line from memory. A file
+// that does not hold what was written is flagged as changed on disk.
+void Buffer::finish_save(uint64_t saved_change_count) {
+  struct stat file_stat;
+
+  saving = false;
+  disk_stamp =
+      make_file_stamp(stat(filename.c_str(), &file_stat), file_stat);
+  changed_on_disk = false;
+
+  int saved_fd = lines.get_change_count() == saved_change_count
+                     ? ::open(filename.c_str(), O_RDONLY)
+                     : -1;
+  bool is_rebased = saved_fd != -1 && lines.rebase(saved_fd);
+
+  if (file_descriptor != -1) {
+    close(file_descriptor);
+    file_descriptor = -1;
+  }
+
+  if (is_rebased) {
+    file_descriptor = saved_fd;
+    edits_count = 0;
+    return;
+  }
+
+  if (saved_fd != -1) {
+    close(saved_fd);
+  }
+
+  if (lines.get_change_count() == saved_change_count) {
+    changed_on_disk = true;
+    edits_count = std::max(edits_count, 1);
+  }
+}
+
+void Buffer::abort_save() {
+  saving = false;
+}
+
+int Buffer::duplicate_file_descriptor() const {
+  return file_descriptor == -1 ? -1 : dup(file_descriptor);
+}
+
+const FileStamp& Buffer::get_disk_stamp() const {
+  return disk_stamp;
+}
+
+// Whether the file was replaced or written to since it was loaded or saved.
+// A file that went away does not count, saving simply creates it again.
+bool Buffer::has_changed_on_disk() const {
+  struct stat file_stat;
+
+  if (!disk_stamp.exists || stat(filename.c_str(), &file_stat) == -1) {
+    return false;
+  }
+
+  return !(make_file_stamp(0, file_stat) == disk_stamp);
+}
+
+// Runs on a worker thread. Compares the file on disk with a snapshot of the
+// buffer as a unified diff, which is empty when they hold the same lines.
+// Lines are only compared by their hashes. The file and the working memory
+// come from resource.
+std::vector<std::string> Buffer::diff_lines(const std::string& filename,
+                                            const LineSnapshot& lines,
+                                            std::pmr::memory_resource* resource,
+                                            const CancellationToken& token) {
+  int disk_fd = ::open(filename.c_str(), O_RDONLY);
+
+  if (disk_fd == -1) {
+    throw std::runtime_error{"diff: could not open file " + filename};
+  }
+
+  LineStore disk_lines{resource, resource};
+
+  try {
+    disk_lines.read(disk_fd);
+  } catch (const std::runtime_error&) {
+    close(disk_fd);
+    throw std::runtime_error{"diff: could not read file " + filename};
+  }
+
+  close(disk_fd);
+
+  std::pmr::vector<uint64_t> disk_hashes(disk_lines.size(), resource);
+  std::pmr::vector<uint64_t> buffer_hashes(lines.size(), resource);
+  std::hash<std::string_view> hash;
+
+  parallel_for(disk_lines.size(), [&](std::size_t begin, std::size_t end,
+                                      std::size_t) {
+    for (std::size_t i = begin; i < end; i++) {
+      disk_hashes[i] = hash(disk_lines[i]);
+    }
+  });
+
+  parallel_for(lines.size(), [&](std::size_t begin, std::size_t end,
+                                 std::size_t) {
+    for (std::size_t i = begin; i < end; i++) {
+      buffer_hashes[i] = hash(lines[i]);
+    }
+  });
+
+  std::vector<DiffHunk> hunks = diff_hashes(disk_hashes, buffer_hashes, token);
+
+  return format_unified_diff(filename + " (on disk)", filename + " (buffer)",
+                             disk_lines, disk_lines.size(), lines, hunks);
+}
+
+// Returns the line for editing, it is serialized from memory on the next save
+std::pmr::string& Buffer::edit_line(int line_number) {
+  rendered_lines.erase(line_number);
+  return lines.edit(line_number);
+}
+
+void Buffer::insert_line(int line_number, std::string_view text) {
+  lines.insert(line_number, text);
+  invalidate_rendered_lines();
+}
+
+void Buffer::erase_line(int line_number) {
+  lines.erase(line_number);
+  invalidate_rendered_lines();
+}
+
+// Needed whenever lines move to a different line number
+void Buffer::invalidate_rendered_lines() {
+  rendered_lines.clear();
+}
+
+const std::pmr::string& Buffer::get_rendered_line(int line_number) {
+  auto cached_line = rendered_lines.find(line_number);
+
+  if (cached_line != rendered_lines.end()) {
+    return cached_line->second;
+  }
+
+  if (rendered_lines.size() >= BUFFER_RENDER_CACHE_LIMIT) {
+    rendered_lines.clear();
+  }
+
+  std::pmr::string line{lines[line_number], rendered_lines.get_allocator()};
+  std::string tab_char{"\t"};
+  std::string spaces(KILO_TAB_STOP, ' ');
+
+  auto char_index = line.find(tab_char);
+
+  while (char_index != std::string::npos) {
+    line.replace(char_index, tab_char.size(), spaces);
+    char_index = line.find(tab_char);
+  }
+
+  return rendered_lines[line_number] = std::move(line);
+}
+
+bool Buffer::is_loaded() const {
+  return loaded;
+}
+
+bool Buffer::is_loading() const {
+  return loading;
+}
+
+bool Buffer::is_hex_view() const {
+  return hex_view != nullptr;
+}
+
+// Rows of the hex view or lines of text
+int64_t Buffer::get_row_count() const {
+  return hex_view != nullptr ? hex_view->get_row_count() : lines.size();
+}
+
+bool Buffer::is_saving() const {
+  return saving;
+}
+
+bool Buffer::is_modified() const {
+  return edits_count > 0;
+}
+
+std::size_t Buffer::get_occurence_count() const {
+  return search_results != nullptr ? search_results->occurences.size() : 0;
+}
+
+std::string Buffer::get_display_name() const {
+  if (filename.length() > 0) {
+    return filename;
+  }
+
+  return scratch_name.length() > 0 ? scratch_name : "[No Name]";
+}
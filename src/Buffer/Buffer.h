@@ -0,0 +1,170 @@
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <array>
+#include <cstdint>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <string_view>
+#include <unordered_map>
+#include <memory_resource>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "../FileWriter/FileWriter.h"
+#include "../LineStore/LineStore.h"
+#include "../TaskScheduler/TaskScheduler.h"
+#include "../HexView/HexView.h"
+#include "../Parallel/Parallel.h"
+#include "../Diff/Diff.h"
+#include "../MemoryAccount/MemoryAccount.h"
+
+#define KILO_TAB_STOP 4
+// Rendered lines are cached for what is on screen, not the whole buffer
+#define BUFFER_RENDER_CACHE_LIMIT 4096
+// Shorter unmodified spans are written from memory, copying them costs more
+// system calls than the bytes are worth
+#define BUFFER_MIN_COPIED_SPAN (64 * 1024)
+
+// Rows are 64 bits wide, the hex view of a file over 32 GiB has more than
+// 2^31 of them
+struct CursorPosition {
+  int x;
+  int64_t y;
+};
+
+// Identifies a version of a file on disk, which changes whenever another
+// program writes or replaces it
+struct FileStamp {
+  bool exists{false};
+  dev_t device{0};
+  ino_t inode{0};
+  off_t size{0};
+  struct timespec modified{0, 0};
+
+  bool operator==(const FileStamp& other) const;
+};
+
+// Where a search matched: the column, then the line
+typedef std::array<unsigned int, 2> SearchOccurence;
+
+// The matches of one search. They live in an arena of their own, which goes
+// away in one piece when the next search replaces them.
+struct SearchResults {
+  SearchResults(std::pmr::memory_resource* upstream);
+
+  std::pmr::monotonic_buffer_resource arena;
+  std::pmr::vector<SearchOccurence> occurences;
+};
+
+struct SaveStatistics {
+  off_t written_bytes{0};
+  off_t reused_bytes{0};
+};
+
+// An open file. Buffers are loaded the first time they are viewed and may be
+// evicted again while unmodified, in which case the next view re-reads them.
+// The file is read into a block from file_memory, which has to outlive the
+// buffer since snapshots handed to tasks share the block. The line table and
+// edited lines come from a pool on top of the editor's shared arena, so
+// closing a buffer returns its memory in bulk. The pool is only released
+// along with the buffer, as the lines keep some of it even when empty;
+// unloading gives memory back to the pool for the next load. What the lines
+// allocate is recorded in the given account. Rendered lines are cached here
+// rather than per viewport, so every split showing the buffer shares them;
+// they are allocated from render_memory.
+//
+// Reading and writing the file happen on worker threads: begin_*() runs on
+// the UI thread, the work itself only touches what it was handed, and
+// finish_*() or abort_*() apply the outcome on the UI thread again. While any
+// task refers to the buffer, pending_tasks is non-zero and the buffer must
+// not be destroyed.
+class Buffer {
+private:
+  // Declared first, everything allocated from it must be destroyed before it
+  std::pmr::synchronized_pool_resource pool;
+  TrackingResource line_memory;
+  std::pmr::memory_resource* file_memory;
+
+public:
+  Buffer(const std::string& filename, std::pmr::memory_resource* arena,
+         MemoryAccount* account, std::pmr::memory_resource* file_memory,
+         std::pmr::memory_resource* render_memory);
+  ~Buffer();
+
+  bool begin_load();
+  std::shared_ptr<LineStore> read_lines();
+  void finish_load(std::shared_ptr<LineStore> loaded_lines);
+  void abort_load();
+  void load_scratch(const std::string& name,
+                    const std::vector<std::string>& contents);
+  void unload();
+  void evict();
+  void enter_hex_view();
+  void leave_hex_view();
+
+  LineSnapshot begin_save(std::pmr::memory_resource* snapshot_resource);
+  static SaveStatistics write_lines(const std::string& filename,
+                                    const LineSnapshot& lines, int source_fd,
+                                    const FileStamp& source_stamp);
+  void finish_save(uint64_t saved_change_count);
+  void abort_save();
+  int duplicate_file_descriptor() const;
+  const FileStamp& get_disk_stamp() const;
+  bool has_changed_on_disk() const;
+  static std::vector<std::string>
+  diff_lines(const std::string& filename, const LineSnapshot& lines,
+             std::pmr::memory_resource* resource,
+             const CancellationToken& token);
+
+  std::pmr::string& edit_line(int line_number);
+  void insert_line(int line_number, std::string_view text);
+  void erase_line(int line_number);
+  void invalidate_rendered_lines();
+  const std::pmr::string& get_rendered_line(int line_number);
+
+  bool is_loaded() const;
+  bool is_loading() const;
+  bool is_hex_view() const;
+  int64_t get_row_count() const;
+  bool is_saving() const;
+  bool is_modified() const;
+  std::size_t get_occurence_count() const;
+  std::string get_display_name() const;
+
+  LineStore lines;
+  // Set instead of lines while the buffer is shown as hex
+  std::shared_ptr<const HexView> hex_view;
+  std::string filename;
+  // Names a buffer that has no file, such as the output of diff
+  std::string scratch_name;
+  int edits_count{0};
+  // Set once another program changed the file of a modified buffer
+  bool changed_on_disk{false};
+  CursorPosition cursor_position{0, 0};
+  int64_t vertical_scroll_offset{0};
+  int horizontal_scroll_offset{0};
+  std::shared_ptr<const SearchResults> search_results;
+  int current_occurence_index{0};
+  unsigned long last_viewed{0};
+  CancellationToken cancellation;
+  CancellationToken search_cancellation;
+  std::string search_pattern;
+  int pending_tasks{0};
+
+private:
+  int file_descriptor{-1};
+  bool loaded{false};
+  bool loading{false};
+  bool saving{false};
+  bool hex_mode{false};
+  bool binary_checked{false};
+  FileStamp disk_stamp;
+  std::pmr::unordered_map<int, std::pmr::string> rendered_lines;
+};
+
+#endif // !BUFFER_H
@@ -0,0 +1,266 @@
+#include "Diff.h"
+
+// Linear space Myers ("An O(ND) Difference Algorithm and Its Variations",
+// section 4b): find the middle snake of the edit graph by searching forwards
+// from the top left and backwards from the bottom right at the same time,
+// then recurse on both halves. Lines only ever compare by hash.
+class MyersDiff {
+public:
+  MyersDiff(const std::pmr::vector<uint64_t>& old_hashes,
+            const std::pmr::vector<uint64_t>& new_hashes,
+            const CancellationToken& token)
+      : a(old_hashes), b(new_hashes), token(token),
+        forward(a.size() + b.size() + 3, a.get_allocator()),
+        backward(a.size() + b.size() + 3, a.get_allocator()),
+        diagonal_offset(b.size() + 1),
+        old_changed(a.size(), false, a.get_allocator()),
+        new_changed(b.size(), false, a.get_allocator()) {
+    max_cost = std::max<long>(DIFF_MIN_MAX_COST,
+                              std::sqrt((double)(a.size() + b.size())));
+  }
+
+  void run() {
+    compare(0, a.size(), 0, b.size());
+  }
+
+  std::vector<DiffHunk> get_hunks() const {
+    std::vector<DiffHunk> hunks;
+    std::size_t i = 0;
+    std::size_t j = 0;
+
+    while (i < a.size() || j < b.size()) {
+      if (i < a.size() && j < b.size() && !old_changed[i] && !new_changed[j]) {
+        i++;
+        j++;
+        continue;
+      }
+
+      DiffHunk hunk{i, 0, j, 0};
+
+      while (i < a.size() && old_changed[i]) {
+        i++;
+        hunk.old_count++;
+      }
+
+      while (j < b.size() && new_changed[j]) {
+        j++;
+        hunk.new_count++;
+      }
+
+      hunks.push_back(hunk);
+    }
+
+    return hunks;
+  }
+
+private:
+  struct Split {
+    long old_index;
+    long new_index;
+  };
+
+  const std::pmr::vector<uint64_t>& a;
+  const std::pmr::vector<uint64_t>& b;
+  const CancellationToken& token;
+  // Furthest old index reached on each diagonal (old index - new index)
+  std::pmr::vector<long> forward;
+  std::pmr::vector<long> backward;
+  long diagonal_offset;
+  long max_cost;
+  std::pmr::vector<bool> old_changed;
+  std::pmr::vector<bool> new_changed;
+
+  long& forward_at(long diagonal) {
+    return forward[diagonal + diagonal_offset];
+  }
+
+  long& backward_at(long diagonal) {
+    return backward[diagonal + diagonal_offset];
+  }
+
+  void compare(long old_begin, long old_end, long new_begin, long new_end) {
+    // Common prefixes and suffixes need no search
+    while (old_begin < old_end && new_begin < new_end &&
+           a[old_begin] == b[new_begin]) {
+      old_begin++;
+      new_begin++;
+    }
+
+    while (old_begin < old_end && new_begin < new_end &&
+           a[old_end - 1] == b[new_end - 1]) {
+      old_end--;
+      new_end--;
+    }
+
+    if (old_begin == old_end) {
+      std::fill(new_changed.begin() + new_begin, new_changed.begin() + new_end,
+                true);
+    } else if (new_begin == new_end) {
+      std::fill(old_changed.begin() + old_begin, old_changed.begin() + old_end,
+                true);
+    } else if (!token.is_cancelled()) {
+      Split split = find_split(old_begin, old_end, new_begin, new_end);
+
+      compare(old_begin, split.old_index, new_begin, split.new_index);
+      compare(split.old_index, old_end, split.new_index, new_end);
+    }
+  }
+
+  Split find_split(long old_begin, long old_end, long new_begin,
+                   long new_end) {
+    long min_diagonal = old_begin - new_end;
+    long max_diagonal = old_end - new_begin;
+    long forward_mid = old_begin - new_begin;
+    long backward_mid = old_end - new_end;
+    bool is_odd = (forward_mid - backward_mid) & 1;
+    long forward_min = forward_mid;
+    long forward_max = forward_mid;
+    long backward_min = backward_mid;
+    long backward_max = backward_mid;
+
+    forward_at(forward_mid) = old_begin;
+    backward_at(backward_mid) = old_end;
+
+    for (long cost = 1;; cost++) {
+      // Extend the forward paths by one edit each
+      if (forward_min > min_diagonal) {
+        forward_at(--forward_min - 1) = -1;
+      } else {
+        forward_min++;
+      }
+
+      if (forward_max < max_diagonal) {
+        forward_at(++forward_max + 1) = -1;
+      } else {
+        forward_max--;
+      }
+
+      for (long diagonal = forward_max; diagonal >= forward_min;
+           diagonal -= 2) {
+        long i = forward_at(diagonal - 1) >= forward_at(diagonal + 1)
+                     ? forward_at(diagonal - 1) + 1
+                     : forward_at(diagonal + 1);
+        long j = i - diagonal;
+
+        while (i < old_end && j < new_end && a[i] == b[j]) {
+          i++;
+          j++;
+        }
+
+        forward_at(diagonal) = i;
+
+        if (is_odd && backward_min <= diagonal && diagonal <= backward_max &&
+            backward_at(diagonal) <= i) {
+          return Split{i, j};
+        }
+      }
+
+      // Extend the backward paths by one edit each
+      if (backward_min > min_diagonal) {
+        backward_at(--backward_min - 1) = LONG_MAX;
+      } else {
+        backward_min++;
+      }
+
+      if (backward_max < max_diagonal) {
+        backward_at(++backward_max + 1) = LONG_MAX;
+      } else {
+        backward_max--;
+      }
+
+      for (long diagonal = backward_max; diagonal >= backward_min;
+           diagonal -= 2) {
+        long i = backward_at(diagonal - 1) < backward_at(diagonal + 1)
+                     ? backward_at(diagonal - 1)
+                     : backward_at(diagonal + 1) - 1;
+        long j = i - diagonal;
+
+        while (i > old_begin && j > new_begin && a[i - 1] == b[j - 1]) {
+          i--;
+          j--;
+        }
+
+        backward_at(diagonal) = i;
+
+        if (!is_odd && forward_min <= diagonal && diagonal <= forward_max &&
+            i <= forward_at(diagonal)) {
+          return Split{i, j};
+        }
+      }
+
+      if (cost >= max_cost || token.is_cancelled()) {
+        return find_best_split(old_begin, old_end, new_begin, new_end,
+                               forward_min, forward_max, backward_min,
+                               backward_max);
+      }
+    }
+  }
+
+  // Too expensive to find the optimal split, take the path that got furthest
+  // in either direction instead
+  Split find_best_split(long old_begin, long old_end, long new_begin,
+                        long new_end, long forward_min, long forward_max,
+                        long backward_min, long backward_max) {
+    long forward_best = -1;
+    long forward_best_i = 0;
+
+    for (long diagonal = forward_max; diagonal >= forward_min;
+         diagonal -= 2) {
+      long i = std::min(forward_at(diagonal), old_end);
+      long j = i - diagonal;
+
+      if (j > new_end) {
+        i = new_end + diagonal;
+        j = new_end;
+      }
+
+      if (i + j > forward_best) {
+        forward_best = i + j;
+        forward_best_i = i;
+      }
+    }
+
+    long backward_best = LONG_MAX;
+    long backward_best_i = 0;
+
+    for (long diagonal = backward_max; diagonal >= backward_min;
+         diagonal -= 2) {
+      long i = std::max(old_begin, backward_at(diagonal));
+      long j = i - diagonal;
+
+      if (j < new_begin) {
+        i = new_begin + diagonal;
+        j = new_begin;
+      }
+
+      if (i + j < backward_best) {
+        backward_best = i + j;
+        backward_best_i = i;
+      }
+    }
+
+    if ((old_end + new_end) - backward_best <
+        forward_best - (old_begin + new_begin)) {
+      return Split{forward_best_i, forward_best - forward_best_i};
+    }
+
+    return Split{backward_best_i, backward_best - backward_best_i};
+  }
+};
+
+// Returns the changed runs in order. An empty result means the sequences are
+// equal, or that the token was cancelled. The working memory, linear in the
+// number of lines, comes from the resource of old_hashes.
+std::vector<DiffHunk> diff_hashes(const std::pmr::vector<uint64_t>& old_hashes,
+                                  const std::pmr::vector<uint64_t>& new_hashes,
+                                  const CancellationToken& token) {
+  MyersDiff diff{old_hashes, new_hashes, token};
+
+  diff.run();
+
+  if (token.is_cancelled()) {
+    return {};
+  }
+
+  return diff.get_hunks();
+}
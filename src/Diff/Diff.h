@@ -0,0 +1,119 @@
+#ifndef DIFF_H
+#define DIFF_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cmath>
+#include <climits>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory_resource>
+#include <algorithm>
+
+#include "../TaskScheduler/TaskScheduler.h"
+
+// Lines of context around each hunk, as in `diff -u`
+#define DIFF_CONTEXT_LINES 3
+// The search for an optimal split gives up after max(this, sqrt(N + M))
+// steps and settles for the best split found so far, so that two mostly
+// different files still diff quickly, at the cost of a longer diff
+#define DIFF_MIN_MAX_COST 256
+
+// A run of changed lines: old lines [old_begin, old_begin + old_count) were
+// replaced by new lines [new_begin, new_begin + new_count)
+struct DiffHunk {
+  std::size_t old_begin;
+  std::size_t old_count;
+  std::size_t new_begin;
+  std::size_t new_count;
+};
+
+std::vector<DiffHunk> diff_hashes(const std::pmr::vector<uint64_t>& old_hashes,
+                                  const std::pmr::vector<uint64_t>& new_hashes,
+                                  const CancellationToken& token);
+
+// Formats hunks like `diff -u` does, grouping changes that are close enough
+// to share their context. Lines are read through old_lines[i] and
+// new_lines[i], which must return something convertible to string_view.
+template <typename OldLines, typename NewLines>
+std::vector<std::string> format_unified_diff(
+    const std::string& old_name, const std::string& new_name,
+    const OldLines& old_lines, std::size_t old_size,
+    const NewLines& new_lines, const std::vector<DiffHunk>& hunks) {
+  std::vector<std::string> output;
+
+  if (hunks.empty()) {
+    return output;
+  }
+
+  output.push_back("--- " + old_name);
+  output.push_back("+++ " + new_name);
+
+  std::size_t first = 0;
+
+  while (first < hunks.size()) {
+    // Take every following hunk whose context would overlap
+    std::size_t last = first;
+
+    while (last + 1 < hunks.size() &&
+           hunks[last + 1].old_begin - (hunks[last].old_begin +
+                                        hunks[last].old_count) <=
+               2 * DIFF_CONTEXT_LINES) {
+      last++;
+    }
+
+    std::size_t old_begin =
+        hunks[first].old_begin -
+        std::min<std::size_t>(hunks[first].old_begin, DIFF_CONTEXT_LINES);
+    std::size_t new_begin =
+        hunks[first].new_begin - (hunks[first].old_begin - old_begin);
+    std::size_t old_end =
+        std::min(old_size, hunks[last].old_begin + hunks[last].old_count +
+                               DIFF_CONTEXT_LINES);
+    std::size_t new_end =
+        hunks[last].new_begin + hunks[last].new_count +
+        (old_end - (hunks[last].old_begin + hunks[last].old_count));
+
+    char header[96];
+    snprintf(header, sizeof(header), "@@ -%zu,%zu +%zu,%zu @@",
+             old_begin + (old_end > old_begin ? 1 : 0), old_end - old_begin,
+             new_begin + (new_end > new_begin ? 1 : 0), new_end - new_begin);
+    output.push_back(header);
+
+    std::size_t old_line = old_begin;
+
+    for (std::size_t index = first; index <= last; index++) {
+      const DiffHunk& hunk = hunks[index];
+
+      for (; old_line < hunk.old_begin; old_line++) {
+        output.push_back(" " + std::string{std::string_view{
+                                   old_lines[old_line]}});
+      }
+
+      for (std::size_t i = 0; i < hunk.old_count; i++) {
+        output.push_back("-" + std::string{std::string_view{
+                                   old_lines[hunk.old_begin + i]}});
+      }
+
+      for (std::size_t i = 0; i < hunk.new_count; i++) {
+        output.push_back("+" + std::string{std::string_view{
+                                   new_lines[hunk.new_begin + i]}});
+      }
+
+      old_line = hunk.old_begin + hunk.old_count;
+    }
+
+    for (; old_line < old_end; old_line++) {
+      output.push_back(" " +
+                       std::string{std::string_view{old_lines[old_line]}});
+    }
+
+    first = last + 1;
+  }
+
+  return output;
+}
+
+#endif // !DIFF_H
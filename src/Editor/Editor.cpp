@@ -1,44 +1,127 @@
 #include "Editor.h"
 
-Editor::Editor(const std::string& filename) {
-  try {
-    initialize();
+Editor::Editor(Server* server) : server(server) {
+  initialize();
+}
 
-    if (filename.length() > 0) {
-      open(filename);
-    }
+Editor::~Editor() {
+  if (task_scheduler != nullptr) {
+    stop_background_tasks();
+  }
+
+  terminal = nullptr;
+  frame_scheduler = nullptr;
+  window = nullptr;
+  screen_buffer = nullptr;
+}
 
-    set_status_message("HELP: Ctrl-S = Save | Ctrl-Q = Quit | Ctrl-F = Find | "
-                       "Ctrl-N/P = Next/Prev Word");
+// Runs a session on the given terminal until the user quits or the terminal
+// goes away. Returns whether the editor should go on serving sessions.
+bool Editor::attach(const Session& session) {
+  input_fd = session.input_fd;
+  output_fd = session.output_fd;
+  connection_fd = session.connection_fd;
+  session_ended = false;
+  awaiting_user_choice = false;
 
-    while (true) {
-      refresh_screen();
-      process_input();
+  std::string error;
+
+  try {
+    if (session.working_directory.length() > 0 &&
+        chdir(session.working_directory.c_str()) == -1) {
+      throw std::runtime_error{"attach: could not change to directory " +
+                               session.working_directory};
     }
+
+    terminal = std::make_unique<Terminal>(input_fd);
+    window = create_window();
+    window->height -= 2;
+    frame_composer->invalidate();
+    frame_scheduler->request_frame();
+
+    set_status_message("HELP: ^S Save | ^Q Quit | ^F Find | ^R Replace | "
+                       "^E Command | ^B Next Buffer");
+
+    open_files(session.filenames);
+
+    // Files may have changed while no session was watching
+    check_files_on_disk(true);
+
+    run();
   } catch (std::exception const& e) {
-    std::cout << e.what() << std::endl;
+    error = e.what();
   }
-}
 
-Editor::~Editor() {
   terminal = nullptr;
-  window = nullptr;
-  screen_buffer = nullptr;
+
+  std::string farewell{escape_map["clear_screen"] +
+                       escape_map["reset_cursor_pos"]};
+
+  if (error.length() > 0) {
+    farewell += error + "\r\n";
+  }
+
+  write(output_fd, farewell.c_str(), farewell.length());
+
+  return !shutdown_requested;
+}
+
+void Editor::run() {
+  while (!session_ended) {
+    std::vector<int> notification_fds{task_scheduler->get_notification_fd(),
+                                      file_watcher->get_notification_fd()};
+
+    if (connection_fd != -1) {
+      notification_fds.push_back(connection_fd);
+    }
+
+    if (server != nullptr) {
+      notification_fds.push_back(server->get_notification_fd());
+    }
+
+    if (frame_scheduler->wait_for_input(input_fd, notification_fds)) {
+      // Handle every key that is already queued before drawing, so bursts
+      // of input are coalesced into a single frame
+      do {
+        process_input();
+        frame_scheduler->input_processed();
+      } while (!session_ended && frame_scheduler->has_pending_input(input_fd));
+    }
+
+    if (session_ended || is_terminal_closed()) {
+      break;
+    }
+
+    if (server != nullptr) {
+      server->reject_pending();
+    }
+
+    // Results of background work are applied between keystrokes
+    if (task_scheduler->run_completions()) {
+      frame_scheduler->request_frame();
+    }
+
+    check_files_on_disk();
+
+    if (frame_scheduler->is_frame_due()) {
+      refresh_screen();
+      frame_scheduler->frame_rendered();
+    }
+  }
 }
 
 void Editor::initialize() {
-  terminal = std::make_unique<Terminal>();
-  window = create_window();
-  screen_buffer = std::make_unique<AppendBuffer>();
-  cursor_position = CursorPosition{0, 0};
-  vertical_scroll_offset = 0;
-  horizontal_scroll_offset = 0;
-  filename = "";
+  screen_buffer = std::make_unique<AppendBuffer>(&render_resource);
+  frame_scheduler =
+      std::make_unique<FrameScheduler>(KILO_MAX_FRAMES_PER_SECOND);
+  arena = std::make_unique<Arena>();
+  file_resource =
+      std::make_unique<TrackingResource>(&buffer_memory, arena.get());
+  task_scheduler = std::make_unique<TaskScheduler>();
+  file_watcher = std::make_unique<FileWatcher>();
   status_message.contents[0] = '\0';
   status_message.timestamp = 0;
-  edits_count = 0;
   awaiting_user_choice = false;
-  current_occurence_index = 0;
 
   escape_map["show_cursor"] = "\x1b[?25l";
   escape_map["hide_cursor"] = "\x1b[?25h";
@@ -51,33 +134,572 @@ void Editor::initialize() {
   escape_map["normal_colors"] = "\x1b[m";
   escape_map["clear_line"] = "\x1b[K";
 
-  window->height -= 2;
+  frame_composer = std::make_unique<FrameComposer>(
+      escape_map["cursor_pos"], escape_map["clear_screen"], &render_resource);
+}
+
+// Adds buffers for the files that are not open yet, and shows the first one.
+// Files are only read when first viewed. Without files, the session goes on
+// where the last one left off.
+void Editor::open_files(const std::vector<std::string>& filenames) {
+  std::vector<std::string> paths;
+
+  for (const std::string& filename : filenames) {
+    paths.push_back(resolve_path(filename));
+
+    if (find_buffer(paths.back()) == buffers.size()) {
+      buffers.push_back(create_buffer(paths.back()));
+    }
+  }
+
+  if (buffers.empty()) {
+    buffers.push_back(create_buffer(""));
+  }
+
+  if (layout == nullptr) {
+    layout = std::make_unique<Layout>(nullptr);
+    viewport = layout->get_viewports().front();
+  }
+
+  if (paths.empty() && buffer != nullptr) {
+    return;
+  }
+
+  std::size_t index = paths.empty() ? 0 : find_buffer(paths.front());
+
+  try {
+    view_buffer(index);
+  } catch (const std::exception& e) {
+    // Not kept around for later sessions to trip over
+    if (server != nullptr && buffers[index].get() != buffer &&
+        !buffers[index]->is_loaded()) {
+      buffers.erase(buffers.begin() + index);
+    }
+
+    throw;
+  }
+}
+
+std::unique_ptr<Buffer> Editor::create_buffer(const std::string& filename) {
+  return std::make_unique<Buffer>(filename, arena.get(), &buffer_memory,
+                                  file_resource.get(), &render_resource);
+}
+
+std::size_t Editor::find_buffer(const std::string& filename) const {
+  for (std::size_t index = 0; index < buffers.size(); index++) {
+    if (buffers[index]->filename == filename) {
+      return index;
+    }
+  }
+
+  return buffers.size();
+}
+
+// Sessions may come from any directory, so a daemon keeps files by their
+// absolute path
+std::string Editor::resolve_path(const std::string& filename) const {
+  if (server == nullptr || filename.length() == 0 || filename[0] == '/') {
+    return filename;
+  }
+
+  char working_directory[PATH_MAX];
+
+  if (getcwd(working_directory, sizeof(working_directory)) == nullptr) {
+    return filename;
+  }
+
+  return std::string{working_directory} + "/" + filename;
+}
+
+// Whether the terminal hung up, or the client it belongs to went away
+bool Editor::is_terminal_closed() const {
+  struct pollfd descriptors[2]{{input_fd, 0, 0}, {connection_fd, POLLIN, 0}};
+
+  if (poll(descriptors, connection_fd == -1 ? 1 : 2, 0) <= 0) {
+    return false;
+  }
+
+  return (descriptors[0].revents & (POLLHUP | POLLERR | POLLNVAL)) ||
+         (connection_fd != -1 && descriptors[1].revents != 0);
 }
 
+// Opens a file in a new buffer, or switches to it if it is already open
 void Editor::open(const std::string& filename) {
-  this->filename = filename;
+  std::size_t index = find_buffer(filename);
+
+  if (index < buffers.size()) {
+    view_buffer(index);
+    return;
+  }
+
+  buffers.push_back(create_buffer(filename));
+
+  try {
+    view_buffer(buffers.size() - 1);
+  } catch (const std::exception& e) {
+    buffers.pop_back();
+    throw;
+  }
+}
+
+// Shows a buffer in the active viewport. The position the viewport had in its
+// previous buffer is remembered in that buffer for the next time it is shown.
+void Editor::view_buffer(std::size_t index) {
+  Buffer* next_buffer = buffers.at(index).get();
+
+  load_buffer(next_buffer);
+
+  if (buffer != nullptr) {
+    buffer->cursor_position = viewport->cursor_position;
+    buffer->vertical_scroll_offset = viewport->vertical_scroll_offset;
+    buffer->horizontal_scroll_offset = viewport->horizontal_scroll_offset;
+  }
+
+  buffer = next_buffer;
+  buffer->last_viewed = ++view_count;
+
+  viewport->buffer = buffer;
+  viewport->cursor_position = buffer->cursor_position;
+  viewport->vertical_scroll_offset = buffer->vertical_scroll_offset;
+  viewport->horizontal_scroll_offset = buffer->horizontal_scroll_offset;
+
+  evict_idle_buffers();
+}
+
+// Reads a buffer's lines in the background. Only opening the file happens
+// right away, so a file that cannot be opened is still reported by throwing.
+void Editor::load_buffer(Buffer* target) {
+  file_watcher->watch(target->filename);
+
+  if (!target->begin_load()) {
+    return;
+  }
+
+  CancellationToken token = target->cancellation;
+  target->pending_tasks++;
+
+  task_scheduler->submit(TaskPriority::Viewport, [this, target, token]() {
+    std::shared_ptr<LineStore> loaded_lines;
+    std::string error;
+
+    if (!token.is_cancelled()) {
+      try {
+        loaded_lines = target->read_lines();
+      } catch (const std::exception& e) {
+        error = e.what();
+      }
+    }
+
+    task_scheduler->post([this, target, token, error,
+                          loaded_lines = std::move(loaded_lines)]() mutable {
+      if (loaded_lines != nullptr && !token.is_cancelled()) {
+        target->finish_load(std::move(loaded_lines));
+        clamp_cursors(target);
+      } else {
+        loaded_lines = nullptr;
+        target->abort_load();
+      }
+
+      if (!error.empty()) {
+        set_status_message("%s", error.c_str());
+      }
+
+      target->pending_tasks--;
+    });
+  });
+}
+
+// Edits are refused while the buffer's lines are still being read
+bool Editor::is_buffer_ready() {
+  if (buffer->is_hex_view()) {
+    set_status_message("Hex view is read-only, use the hex command to edit "
+                       "as text");
+    return false;
+  }
+
+  if (buffer->is_loaded()) {
+    return true;
+  }
+
+  set_status_message(buffer->is_loading() ? "%s is still loading"
+                                          : "%s could not be loaded",
+                     buffer->filename.c_str());
+  return false;
+}
 
-  std::ifstream file{filename};
+// Cancels what can be cancelled and waits for the rest, so that saves in
+// progress are never cut short
+void Editor::stop_background_tasks() {
+  for (const std::unique_ptr<Buffer>& open_buffer : buffers) {
+    open_buffer->cancellation.cancel();
+  }
+
+  task_scheduler->shutdown();
+}
+
+// Cancels the buffer's tasks and waits until none refers to it anymore.
+// Saves are not cancelled, so this also waits for one in progress to finish.
+// Completions of other tasks run meanwhile and may open buffers or change the
+// layout, so callers must not hold iterators into either across the wait.
+void Editor::wait_for_tasks(Buffer* target) {
+  target->cancellation.cancel();
+
+  while (target->pending_tasks > 0) {
+    task_scheduler->wait_for_completions();
+  }
+
+  target->cancellation = CancellationToken{};
+  target->search_cancellation = CancellationToken{};
+}
+
+// Keeps the cursors of the viewports showing a buffer within its rows, after
+// its contents were replaced
+void Editor::clamp_cursors(Buffer* target) {
+  for (Viewport* open_viewport : layout->get_viewports()) {
+    if (open_viewport->buffer == target &&
+        open_viewport->cursor_position.y > target->get_row_count()) {
+      open_viewport->cursor_position =
+          CursorPosition{0, target->get_row_count()};
+    }
+  }
+}
+
+// Handles files that other programs changed. An unmodified buffer simply
+// follows its file, a modified one is only flagged, which also stops it from
+// being saved over the other program's changes until the user decides.
+void Editor::check_files_on_disk(bool check_all) {
+  std::vector<std::string> changes = file_watcher->read_changes();
+
+  if (changes.empty() && !check_all) {
+    return;
+  }
+
+  std::vector<Buffer*> changed_buffers;
+
+  for (const std::unique_ptr<Buffer>& open_buffer : buffers) {
+    Buffer* target = open_buffer.get();
+
+    // The buffer's own saves change the file too, those are told apart by
+    // the stamp recorded when saving
+    if (target->filename.empty() || !target->is_loaded() ||
+        target->is_saving() || target->changed_on_disk ||
+        (!check_all &&
+         std::find(changes.begin(), changes.end(),
+                   canonicalize_path(target->filename)) == changes.end()) ||
+        !target->has_changed_on_disk()) {
+      continue;
+    }
+
+    changed_buffers.push_back(target);
+  }
+
+  // Reloading waits for tasks, whose completions may open buffers, so the
+  // buffers are only walked before that
+  for (Buffer* target : changed_buffers) {
+    if (target->is_modified()) {
+      target->changed_on_disk = true;
+      set_status_message("%s changed on disk! Use diff, reload, or save! to "
+                         "overwrite",
+                         target->filename.c_str());
+    } else {
+      reload_buffer(target);
+      set_status_message("%s changed on disk, reloaded",
+                         target->filename.c_str());
+    }
+
+    frame_scheduler->request_frame();
+  }
+}
+
+// Reads the buffer's file again, dropping any edits
+void Editor::reload_buffer(Buffer* target) {
+  wait_for_tasks(target);
+  target->unload();
+
+  try {
+    load_buffer(target);
+  } catch (const std::exception& e) {
+    set_status_message("%s", e.what());
+  }
+}
+
+// Compares the buffer with its file on disk in the background, and shows the
+// differences next to it
+void Editor::diff_buffer() {
+  if (!is_buffer_ready()) {
+    return;
+  }
+
+  if (buffer->filename.empty()) {
+    set_status_message("Buffer has no file to compare with");
+    return;
+  }
+
+  Buffer* target = buffer;
+  std::shared_ptr<LineSnapshot> lines =
+      std::make_shared<LineSnapshot>(target->lines.snapshot(&search_resource));
+  std::string filename = target->filename;
+  CancellationToken token = target->cancellation;
+
+  target->pending_tasks++;
+  set_status_message("Comparing %s with the file on disk...",
+                     filename.c_str());
+
+  task_scheduler->submit(TaskPriority::Interactive, [this, target, lines,
+                                                     filename, token]() {
+    std::vector<std::string> output;
+    std::string error;
+
+    try {
+      output = Buffer::diff_lines(filename, *lines, &search_resource, token);
+    } catch (const std::exception& e) {
+      error = e.what();
+    }
+
+    task_scheduler->post([this, target, filename, token, error,
+                          output = std::move(output)]() {
+      target->pending_tasks--;
+
+      if (token.is_cancelled()) {
+        return;
+      }
+
+      if (!error.empty()) {
+        set_status_message("%s", error.c_str());
+      } else if (output.empty()) {
+        set_status_message("No changes between %s and the file on disk",
+                           filename.c_str());
+      } else {
+        show_scratch("diff " + filename, output);
+      }
+    });
+  });
+}
+
+// Shows lines in a buffer without a file, below the active viewport if there
+// is room. An idle scratch buffer of the same name is reused; this runs as a
+// completion, so it cannot wait for the tasks of a busy one.
+void Editor::show_scratch(const std::string& name,
+                          const std::vector<std::string>& contents) {
+  auto position = std::find_if(
+      buffers.begin(), buffers.end(),
+      [&](const std::unique_ptr<Buffer>& open_buffer) {
+        return open_buffer->filename.empty() &&
+               open_buffer->scratch_name == name &&
+               open_buffer->pending_tasks == 0;
+      });
+
+  if (position == buffers.end()) {
+    buffers.push_back(create_buffer(""));
+    position = buffers.end() - 1;
+  }
+
+  Buffer* scratch = position->get();
+
+  scratch->load_scratch(name, contents);
+
+  for (Viewport* open_viewport : layout->get_viewports()) {
+    if (open_viewport->buffer == scratch) {
+      open_viewport->cursor_position = CursorPosition{0, 0};
+      open_viewport->vertical_scroll_offset = 0;
+      open_viewport->horizontal_scroll_offset = 0;
+      focus_viewport(open_viewport);
+      return;
+    }
+  }
+
+  Viewport* new_viewport = layout->split(viewport, false);
+
+  if (new_viewport != nullptr) {
+    frame_composer->invalidate();
+    focus_viewport(new_viewport);
+  }
+
+  view_buffer(position - buffers.begin());
+}
+
+// Moves the focus to another viewport, along with the buffer being edited
+void Editor::focus_viewport(Viewport* next_viewport) {
+  viewport = next_viewport;
+  buffer = viewport->buffer;
+  buffer->last_viewed = ++view_count;
+}
+
+void Editor::split_viewport(bool side_by_side) {
+  Viewport* new_viewport = layout->split(viewport, side_by_side);
 
-  if (!file.is_open()) {
-    terminal->terminate("open: could not open file");
+  if (new_viewport == nullptr) {
+    set_status_message("Not enough room to split");
+    return;
   }
 
-  for (std::string line; std::getline(file, line);) {
-    lines.push_back(std::move(line));
+  frame_composer->invalidate();
+  focus_viewport(new_viewport);
+}
+
+void Editor::close_viewport() {
+  Viewport* next_viewport = layout->close(viewport);
+
+  if (next_viewport == nullptr) {
+    set_status_message("Cannot close the last viewport");
+    return;
   }
 
-  edits_count = 0;
+  frame_composer->invalidate();
+  focus_viewport(next_viewport);
+}
+
+void Editor::focus_next_viewport() {
+  std::vector<Viewport*> viewports = layout->get_viewports();
+  auto position = std::find(viewports.begin(), viewports.end(), viewport);
+
+  focus_viewport(*(++position == viewports.end() ? viewports.begin()
+                                                 : position));
+}
+
+void Editor::close_buffer(bool discard_changes) {
+  if (buffer->is_modified() && !discard_changes) {
+    set_status_message(
+        "Buffer has unsaved changes, use close! to discard them");
+    return;
+  }
+
+  Buffer* closed_buffer = buffer;
+
+  wait_for_tasks(closed_buffer);
+
+  // Completions that ran while waiting may have opened buffers or moved the
+  // focus, so the buffer is only looked up now
+  auto position = std::find_if(
+      buffers.begin(), buffers.end(),
+      [&](const std::unique_ptr<Buffer>& open_buffer) {
+        return open_buffer.get() == closed_buffer;
+      });
+  std::size_t index = position - buffers.begin();
+
+  buffer = nullptr;
+  buffers.erase(position);
+
+  // The buffer's pool handed its blocks back to the arena when it was
+  // destroyed, return them to the system as well
+  arena->release_unused();
+
+  if (buffers.empty()) {
+    buffers.push_back(create_buffer(""));
+  }
+
+  // Every viewport that showed the buffer moves on to a neighbouring one. If
+  // the neighbour's file cannot be opened anymore, it shows a buffer that is
+  // already loaded instead, or a new empty one.
+  Viewport* active_viewport = viewport;
+
+  for (Viewport* open_viewport : layout->get_viewports()) {
+    if (open_viewport->buffer != closed_buffer) {
+      continue;
+    }
+
+    viewport = open_viewport;
+    buffer = nullptr;
+
+    try {
+      view_buffer(std::min(index, buffers.size() - 1));
+    } catch (const std::exception& e) {
+      set_status_message("%s", e.what());
+
+      auto loaded_position = std::find_if(
+          buffers.begin(), buffers.end(),
+          [](const std::unique_ptr<Buffer>& open_buffer) {
+            return open_buffer->is_loaded() || open_buffer->is_loading();
+          });
+
+      if (loaded_position == buffers.end()) {
+        buffers.push_back(create_buffer(""));
+        loaded_position = buffers.end() - 1;
+      }
+
+      view_buffer(loaded_position - buffers.begin());
+    }
+  }
+
+  focus_viewport(active_viewport);
+}
+
+// Evicts the least recently viewed unmodified buffers until the arena is back
+// under its memory budget
+void Editor::evict_idle_buffers() {
+  if (arena->get_bytes_in_use() <= KILO_MEMORY_BUDGET) {
+    return;
+  }
+
+  std::vector<Buffer*> idle_buffers;
+
+  std::vector<Viewport*> viewports = layout->get_viewports();
+
+  for (const std::unique_ptr<Buffer>& open_buffer : buffers) {
+    bool is_visible = std::any_of(
+        viewports.begin(), viewports.end(), [&](const Viewport* open_viewport) {
+          return open_viewport->buffer == open_buffer.get();
+        });
+
+    if (!is_visible && open_buffer->is_loaded() &&
+        !open_buffer->is_modified()) {
+      idle_buffers.push_back(open_buffer.get());
+    }
+  }
+
+  std::sort(idle_buffers.begin(), idle_buffers.end(),
+            [](const Buffer* a, const Buffer* b) {
+              return a->last_viewed < b->last_viewed;
+            });
+
+  for (Buffer* idle_buffer : idle_buffers) {
+    idle_buffer->evict();
+
+    if (arena->get_bytes_in_use() <= KILO_MEMORY_BUDGET) {
+      break;
+    }
+  }
+
+  arena->release_unused();
+}
+
+void Editor::list_buffers() {
+  std::string listing;
+
+  for (std::size_t index = 0; index < buffers.size(); index++) {
+    const Buffer& open_buffer = *buffers[index];
+
+    listing += std::to_string(index + 1) + ":";
+    listing += open_buffer.get_display_name();
+    listing += open_buffer.is_modified() ? "+" : "";
+    listing += open_buffer.is_loaded() ? "" : "~";
+    listing += &open_buffer == buffer ? "* " : " ";
+  }
+
+  set_status_message("%s| %zu KB in use", listing.c_str(),
+                     arena->get_bytes_in_use() / 1024);
+}
+
+// Live and peak bytes, and the number of allocations, of every subsystem
+void Editor::show_memory_usage() {
+  std::string usage;
+
+  for (const MemoryAccount* account :
+       {&buffer_memory, &render_memory, &search_memory}) {
+    usage += (usage.empty() ? "" : " | ") + account->describe();
+  }
+
+  set_status_message("%s", usage.c_str());
 }
 
 Window* Editor::create_window() {
   static Window window{};
 
   struct winsize window_size;
-  bool got_window_size = ioctl(STDOUT_FILENO, TIOCGWINSZ, &window_size) != -1;
+  bool got_window_size = ioctl(output_fd, TIOCGWINSZ, &window_size) != -1;
 
   if (!got_window_size || window_size.ws_col == 0) {
-    if (write(STDOUT_FILENO, escape_map["bottom_right_corner"].c_str(), 12) !=
+    if (write(output_fd, escape_map["bottom_right_corner"].c_str(), 12) !=
         12) {
       throw std::runtime_error{
           "create_window: could not reposition cursor to bottom-right edge"};
@@ -100,13 +722,13 @@ CursorPosition Editor::get_cursor_position() {
   char cursor_pos_buffer[32];
   unsigned int i = 0;
 
-  if (write(STDOUT_FILENO, escape_map["device_status"].c_str(), 4) != 4) {
+  if (write(output_fd, escape_map["device_status"].c_str(), 4) != 4) {
     throw std::runtime_error{
         "get_cursor_position: could not retrieve device status report"};
   }
 
   while (i < sizeof(cursor_pos_buffer) - 1) {
-    if (read(STDIN_FILENO, &cursor_pos_buffer[i], 1) != 1) {
+    if (read(input_fd, &cursor_pos_buffer[i], 1) != 1) {
       break;
     }
 
@@ -124,76 +746,116 @@ CursorPosition Editor::get_cursor_position() {
         "get_cursor_position: could not detect escape sequence"};
   }
 
+  int row;
   int num_bytes_read =
-      sscanf(&cursor_pos_buffer[2], "%d;%d", &cursor_pos.x, &cursor_pos.y);
+      sscanf(&cursor_pos_buffer[2], "%d;%d", &cursor_pos.x, &row);
 
   if (num_bytes_read != 2) {
     throw std::runtime_error{
         "get_cursor_position: could not extract x or y coordinates"};
   }
 
+  cursor_pos.y = row;
   return cursor_pos;
 }
 
 void Editor::refresh_screen() {
-  scroll();
+  layout->arrange(window->width, window->height + 1);
 
   screen_buffer->append(escape_map["show_cursor"]);
-  screen_buffer->append(escape_map["clear_screen"]);
-  screen_buffer->append(escape_map["reset_cursor_pos"]);
 
-  draw();
-  draw_status_bar();
+  for (Viewport* open_viewport : layout->get_viewports()) {
+    scroll(open_viewport);
+    draw_viewport(open_viewport);
+    draw_status_bar(open_viewport);
+  }
+
+  for (const CursorPosition& separator : layout->get_separators()) {
+    frame_composer->put(separator.y, separator.x, "|");
+  }
+
   draw_message_bar();
 
+  frame_composer->compose(*screen_buffer);
+
   // Move cursor
+  int cursor_row = viewport->top + viewport->cursor_position.y -
+                   viewport->vertical_scroll_offset;
+  int cursor_column = viewport->left + get_cursor_column(viewport) -
+                      viewport->horizontal_scroll_offset;
+
   char cursor_buffer[32];
   snprintf(cursor_buffer, sizeof(cursor_buffer),
-           escape_map["cursor_pos"].c_str(),
-           (cursor_position.y - vertical_scroll_offset) + 1,
-           (cursor_position.x - horizontal_scroll_offset) + 1);
+           escape_map["cursor_pos"].c_str(), cursor_row + 1, cursor_column + 1);
 
   screen_buffer->append(cursor_buffer);
 
   screen_buffer->append(escape_map["hide_cursor"]);
 
-  screen_buffer->flush();
+  screen_buffer->flush(output_fd);
   screen_buffer->clear();
 }
 
-void Editor::draw() {
-  for (int row = 0; row < window->height; row++) {
-    int line_number = row + vertical_scroll_offset;
+void Editor::draw_viewport(Viewport* viewport) {
+  Buffer* buffer = viewport->buffer;
+
+  if (buffer->is_hex_view()) {
+    draw_hex_viewport(viewport);
+    return;
+  }
+
+  for (int row = 0; row < viewport->height; row++) {
+    int line_number = row + viewport->vertical_scroll_offset;
+    std::string content;
 
     // If no lines have been read, display editor startup screen
-    if (line_number >= (int)lines.size()) {
-      if (lines.size() == 0 && row == window->height / 3) {
-        display_welcome_message();
+    if (line_number >= (int)buffer->lines.size()) {
+      if (buffer->is_loading() && row == viewport->height / 3) {
+        content = "~ Loading " + buffer->filename + "...";
+      } else if (buffer->lines.size() == 0 && row == viewport->height / 3) {
+        content = welcome_message(viewport->width);
       } else {
-        screen_buffer->append("~");
+        content = "~";
       }
     } else {
-      draw_line(line_number);
+      // Rendered lines come from the buffer, shared by all its viewports
+      const std::pmr::string& line = buffer->get_rendered_line(line_number);
+
+      if (viewport->horizontal_scroll_offset < (int)line.length()) {
+        content = line.substr(viewport->horizontal_scroll_offset,
+                              viewport->width);
+      }
     }
 
-    screen_buffer->append("\r\n");
+    content.resize(viewport->width, ' ');
+    frame_composer->put(viewport->top + row, viewport->left, content);
   }
 }
 
-void Editor::draw_line(int line_number) {
-  int line_length = lines[line_number].length() - horizontal_scroll_offset;
+// Rows are read from the file and formatted as they are drawn, nothing is
+// kept between frames
+void Editor::draw_hex_viewport(Viewport* viewport) {
+  const HexView& hex_view = *viewport->buffer->hex_view;
+  std::string row_content;
 
-  if (line_length < 0) {
-    lines[line_number].resize(0);
-  }
+  for (int row = 0; row < viewport->height; row++) {
+    int64_t row_number = row + viewport->vertical_scroll_offset;
+    std::string content;
 
-  if (line_length > window->width) {
-    lines[line_number].resize(window->width);
-  }
+    if (row_number >= hex_view.get_row_count()) {
+      content = "~";
+    } else {
+      hex_view.format_row(row_number, row_content);
 
-  replace_tabs_with_spaces(line_number);
+      if (viewport->horizontal_scroll_offset < (int)row_content.length()) {
+        content = row_content.substr(viewport->horizontal_scroll_offset,
+                                     viewport->width);
+      }
+    }
 
-  screen_buffer->append(lines[line_number].substr(horizontal_scroll_offset));
+    content.resize(viewport->width, ' ');
+    frame_composer->put(viewport->top + row, viewport->left, content);
+  }
 }
 
 void Editor::process_input() {
@@ -202,8 +864,7 @@ void Editor::process_input() {
   // Handle [Y/N] type choices
   if (awaiting_user_choice) {
     if (key == 121) { // 121 = Y, 110 = N
-      terminal->disable_raw_mode();
-      terminal->terminate("force quit initiated");
+      session_ended = true;
     } else {
       awaiting_user_choice = false;
       set_status_message("");
@@ -216,28 +877,61 @@ void Editor::process_input() {
     insert_newline();
     break;
   case 0x1f & 'q': // Ctrl-q
-    if (edits_count > 0) {
+    // A daemon keeps the buffers, unsaved changes included, for the next
+    // session
+    if (server == nullptr &&
+        std::any_of(buffers.begin(), buffers.end(),
+                    [](const std::unique_ptr<Buffer>& open_buffer) {
+                      return open_buffer->is_modified();
+                    })) {
       set_status_message("Warning! There are unsaved changes. Are you sure you "
                          "wish to quit? [Y/N]");
       awaiting_user_choice = true;
     } else {
-      terminal->disable_raw_mode();
-      terminal->terminate("quit initiated");
+      session_ended = true;
     }
     break;
   case 0x1f & 's': // Ctrl-s
     save_file();
     break;
   case EditorKey::Home:
-    cursor_position.x = 0;
+    viewport->cursor_position.x = 0;
     break;
   case EditorKey::End:
-    if (cursor_position.x < (int)lines.size()) {
-      cursor_position.x = lines[cursor_position.y].size();
+    if (buffer->is_hex_view()) {
+      viewport->cursor_position.x = HEX_VIEW_BYTES_PER_ROW - 1;
+    } else if (viewport->cursor_position.x < (int)buffer->lines.size()) {
+      viewport->cursor_position.x =
+          buffer->lines[viewport->cursor_position.y].size();
     }
     break;
   case 0x1f & 'f': // Ctrl-f
-    search();
+    if (buffer->is_hex_view()) {
+      search_bytes();
+    } else {
+      search();
+    }
+    break;
+  case 0x1f & 'r': // Ctrl-r
+    replace_all();
+    break;
+  case 0x1f & 'e': // Ctrl-e
+    execute_command();
+    break;
+  case 0x1f & 'w': // Ctrl-w
+    focus_next_viewport();
+    break;
+  case 0x1f & 'b': // Ctrl-b
+    try {
+      std::size_t index = std::find_if(buffers.begin(), buffers.end(),
+                                       [&](const std::unique_ptr<Buffer>& b) {
+                                         return b.get() == buffer;
+                                       }) -
+                          buffers.begin();
+      view_buffer((index + 1) % buffers.size());
+    } catch (const std::exception& e) {
+      set_status_message("%s", e.what());
+    }
     break;
   case EditorKey::Backspace:
   case EditorKey::Delete:
@@ -247,15 +941,16 @@ void Editor::process_input() {
   case EditorKey::PageUp:
   case EditorKey::PageDown: {
     if (key == EditorKey::PageUp) {
-      cursor_position.y = vertical_scroll_offset;
+      viewport->cursor_position.y = viewport->vertical_scroll_offset;
     } else {
-      cursor_position.y = vertical_scroll_offset + window->height - 1;
-      if (cursor_position.y > (int)lines.size()) {
-        cursor_position.y = lines.size();
+      viewport->cursor_position.y =
+          viewport->vertical_scroll_offset + viewport->height - 1;
+      if (viewport->cursor_position.y > buffer->get_row_count()) {
+        viewport->cursor_position.y = buffer->get_row_count();
       }
     }
 
-    int times = window->height;
+    int times = viewport->height;
     while (times--) {
       move_cursor(key == EditorKey::PageUp ? EditorKey::Up : EditorKey::Down);
     }
@@ -271,20 +966,44 @@ void Editor::process_input() {
   case '\x1b':
     break;
   case 0x1f & 'n': { // Ctrl-n
-    int next_occurence_index =
-        (current_occurence_index + 1) % search_occurences.size();
-    current_occurence_index = next_occurence_index;
-    cursor_position.x = search_occurences[next_occurence_index][0];
-    cursor_position.y = search_occurences[next_occurence_index][1];
+    if (buffer->is_hex_view()) {
+      find_bytes(get_cursor_offset() + 1, true);
+      break;
+    }
+
+    if (buffer->get_occurence_count() == 0) {
+      break;
+    }
+
+    int next_occurence_index = (buffer->current_occurence_index + 1) %
+                               buffer->get_occurence_count();
+    const SearchOccurence& occurence =
+        buffer->search_results->occurences[next_occurence_index];
+    buffer->current_occurence_index = next_occurence_index;
+    viewport->cursor_position.x = occurence[0];
+    viewport->cursor_position.y = occurence[1];
     break;
   }
   case 0x1f & 'p': { // Ctrl-p
-    int prev_occurence_index =
-        (current_occurence_index - 1 + search_occurences.size()) %
-        search_occurences.size();
-    current_occurence_index = prev_occurence_index;
-    cursor_position.x = search_occurences[prev_occurence_index][0];
-    cursor_position.y = search_occurences[prev_occurence_index][1];
+    if (buffer->is_hex_view()) {
+      std::size_t offset = get_cursor_offset();
+      find_bytes(offset > 0 ? offset - 1 : buffer->hex_view->get_size() - 1,
+                 false);
+      break;
+    }
+
+    if (buffer->get_occurence_count() == 0) {
+      break;
+    }
+
+    int prev_occurence_index = (buffer->current_occurence_index - 1 +
+                                buffer->get_occurence_count()) %
+                               buffer->get_occurence_count();
+    const SearchOccurence& occurence =
+        buffer->search_results->occurences[prev_occurence_index];
+    buffer->current_occurence_index = prev_occurence_index;
+    viewport->cursor_position.x = occurence[0];
+    viewport->cursor_position.y = occurence[1];
     break;
   }
   default:
@@ -297,26 +1016,30 @@ int Editor::read_key() {
   int num_bytes_read = 0;
   char key;
 
-  while ((num_bytes_read = read(STDIN_FILENO, &key, 1)) != 1) {
+  while ((num_bytes_read = read(input_fd, &key, 1)) != 1) {
     if (num_bytes_read == -1 && errno != EAGAIN) {
-      terminal->terminate("read_key");
+      throw std::runtime_error{"read_key: could not read from terminal"};
+    }
+
+    if (is_terminal_closed()) {
+      throw std::runtime_error{"read_key: terminal was closed"};
     }
   }
 
   if (key == '\x1b') {
     char sequence[3];
 
-    if (read(STDIN_FILENO, &sequence[0], 1) != 1) {
+    if (read(input_fd, &sequence[0], 1) != 1) {
       return '\x1b';
     }
 
-    if (read(STDIN_FILENO, &sequence[1], 1) != 1) {
+    if (read(input_fd, &sequence[1], 1) != 1) {
       return '\x1b';
     }
 
     if (sequence[0] == '[') {
       if (sequence[1] >= '0' && sequence[1] <= '9') {
-        if (read(STDIN_FILENO, &sequence[2], 1) != 1) {
+        if (read(input_fd, &sequence[2], 1) != 1) {
           return '\x1b';
         }
 
@@ -369,137 +1092,232 @@ int Editor::read_key() {
   return key;
 }
 
-void Editor::display_welcome_message() {
+std::string Editor::welcome_message(int width) {
   char message[80];
   int length = snprintf(message, sizeof(message), "Kilo Editor -- Version %s",
                         KILO_VERSION);
 
-  if (length > window->width) {
-    length = window->width;
+  if (length > width) {
+    length = width;
   }
 
-  int padding = (window->width - length) / 2;
+  std::string content;
+  int padding = (width - length) / 2;
 
   if (padding) {
-    screen_buffer->append("~");
+    content.append("~");
     padding--;
   }
 
-  while (padding--) {
-    screen_buffer->append(" ");
-  }
+  content.append(padding, ' ');
+  content.append(message, length);
 
-  screen_buffer->append(message);
+  return content;
 }
 
 void Editor::move_cursor(int key) {
-  std::string line =
-      (cursor_position.y >= (int)lines.size()) ? "" : lines[cursor_position.y];
+  if (buffer->is_hex_view()) {
+    move_hex_cursor(key);
+    return;
+  }
+
+  std::string_view line =
+      (viewport->cursor_position.y >= (int)buffer->lines.size())
+          ? ""
+          : std::string_view{buffer->lines[viewport->cursor_position.y]};
 
   switch (key) {
   case EditorKey::Left:
-    if (cursor_position.x != 0) {
-      cursor_position.x--;
-    } else if (cursor_position.y > 0) {
-      cursor_position.y--;
-      cursor_position.x = lines[cursor_position.y].length();
+    if (viewport->cursor_position.x != 0) {
+      viewport->cursor_position.x--;
+    } else if (viewport->cursor_position.y > 0) {
+      viewport->cursor_position.y--;
+      viewport->cursor_position.x =
+          buffer->lines[viewport->cursor_position.y].length();
     }
     break;
   case EditorKey::Right:
-    if (!line.empty() && cursor_position.x < (int)line.length()) {
-      cursor_position.x++;
-    } else if (!line.empty() && cursor_position.x == (int)line.length()) {
-      cursor_position.y++;
-      cursor_position.x = 0;
+    if (!line.empty() && viewport->cursor_position.x < (int)line.length()) {
+      viewport->cursor_position.x++;
+    } else if (!line.empty() &&
+               viewport->cursor_position.x == (int)line.length()) {
+      viewport->cursor_position.y++;
+      viewport->cursor_position.x = 0;
     }
     break;
   case EditorKey::Up:
-    if (cursor_position.y != 0) {
-      cursor_position.y--;
+    if (viewport->cursor_position.y != 0) {
+      viewport->cursor_position.y--;
     }
     break;
   case EditorKey::Down:
-    if (cursor_position.y < (int)lines.size()) {
-      cursor_position.y++;
+    if (viewport->cursor_position.y < (int)buffer->lines.size()) {
+      viewport->cursor_position.y++;
     }
     break;
   }
 
-  line = (cursor_position.y >= (int)lines.size()) ? ""
-                                                  : lines.at(cursor_position.y);
+  line = (viewport->cursor_position.y >= (int)buffer->lines.size())
+             ? ""
+             : buffer->lines[viewport->cursor_position.y];
 
-  if (cursor_position.x > (int)line.length()) {
-    cursor_position.x = line.length();
+  if (viewport->cursor_position.x > (int)line.length()) {
+    viewport->cursor_position.x = line.length();
   }
 }
 
-void Editor::scroll() {
-  if (cursor_position.y < vertical_scroll_offset) {
-    vertical_scroll_offset = cursor_position.y;
+// Moves between bytes, wrapping at the end of a row; scroll() keeps the
+// cursor within the file
+void Editor::move_hex_cursor(int key) {
+  int64_t row_count = buffer->hex_view->get_row_count();
+
+  switch (key) {
+  case EditorKey::Left:
+    if (viewport->cursor_position.x > 0) {
+      viewport->cursor_position.x--;
+    } else if (viewport->cursor_position.y > 0) {
+      viewport->cursor_position.y--;
+      viewport->cursor_position.x = HEX_VIEW_BYTES_PER_ROW - 1;
+    }
+    break;
+  case EditorKey::Right:
+    if (viewport->cursor_position.x < HEX_VIEW_BYTES_PER_ROW - 1) {
+      viewport->cursor_position.x++;
+    } else if (viewport->cursor_position.y < row_count - 1) {
+      viewport->cursor_position.y++;
+      viewport->cursor_position.x = 0;
+    }
+    break;
+  case EditorKey::Up:
+    if (viewport->cursor_position.y > 0) {
+      viewport->cursor_position.y--;
+    }
+    break;
+  case EditorKey::Down:
+    if (viewport->cursor_position.y < row_count - 1) {
+      viewport->cursor_position.y++;
+    }
+    break;
   }
+}
 
-  if (cursor_position.y >= vertical_scroll_offset + window->height) {
-    vertical_scroll_offset = cursor_position.y - window->height + 1;
+void Editor::scroll(Viewport* viewport) {
+  const LineStore& lines = viewport->buffer->lines;
+  const HexView* hex_view = viewport->buffer->hex_view.get();
+
+  if (hex_view != nullptr) {
+    // The cursor sits on a byte, there is no position past the last one
+    viewport->cursor_position.y =
+        std::max<int64_t>(0, std::min(viewport->cursor_position.y,
+                                      hex_view->get_row_count() - 1));
+    viewport->cursor_position.x = std::max(
+        0, std::min(viewport->cursor_position.x,
+                    hex_view->get_row_length(viewport->cursor_position.y) -
+                        1));
+  } else {
+    // Another viewport may have removed the lines under this one's cursor
+    if (viewport->cursor_position.y > (int)lines.size()) {
+      viewport->cursor_position.y = lines.size();
+    }
+
+    int line_length = viewport->cursor_position.y < (int)lines.size()
+                          ? lines[viewport->cursor_position.y].length()
+                          : 0;
+
+    if (viewport->cursor_position.x > line_length) {
+      viewport->cursor_position.x = line_length;
+    }
   }
 
-  if (cursor_position.x < horizontal_scroll_offset) {
-    horizontal_scroll_offset = cursor_position.x;
+  int cursor_column = get_cursor_column(viewport);
+
+  if (viewport->cursor_position.y < viewport->vertical_scroll_offset) {
+    viewport->vertical_scroll_offset = viewport->cursor_position.y;
   }
 
-  if (cursor_position.x >= horizontal_scroll_offset + window->width) {
-    horizontal_scroll_offset = cursor_position.x - window->width + 1;
+  if (viewport->cursor_position.y >=
+      viewport->vertical_scroll_offset + viewport->height) {
+    viewport->vertical_scroll_offset =
+        viewport->cursor_position.y - viewport->height + 1;
   }
-}
 
-void Editor::replace_tabs_with_spaces(int line_number) {
-  std::string tab_char{"\t"};
-  std::string spaces(KILO_TAB_STOP, ' ');
+  if (cursor_column < viewport->horizontal_scroll_offset) {
+    viewport->horizontal_scroll_offset = cursor_column;
+  }
 
-  auto char_index = lines[line_number].find("\t");
+  if (cursor_column >= viewport->horizontal_scroll_offset + viewport->width) {
+    viewport->horizontal_scroll_offset = cursor_column - viewport->width + 1;
+  }
+}
 
-  while (char_index != std::string::npos) {
-    lines[line_number].replace(char_index, tab_char.size(), spaces);
-    char_index = lines[line_number].find(tab_char);
+// Where the cursor is drawn within its row. In hex view the cursor is on a
+// byte, and is drawn on that byte's hex digits.
+int Editor::get_cursor_column(Viewport* viewport) {
+  if (viewport->buffer->is_hex_view()) {
+    return viewport->buffer->hex_view->get_byte_column(
+        viewport->cursor_position.x);
   }
+
+  return viewport->cursor_position.x;
 }
 
-void Editor::draw_status_bar() {
-  screen_buffer->append(escape_map["invert_colors"]);
+void Editor::draw_status_bar(Viewport* viewport) {
+  Buffer* buffer = viewport->buffer;
+  std::string content{escape_map["invert_colors"]};
 
   char left_status[100];
   char right_status[80];
 
-  int status_length =
-      snprintf(left_status, sizeof(left_status), "%.20s - %d lines | %s",
-               filename.length() > 0 ? filename.c_str() : "[No Name]",
-               (int)lines.size(), edits_count > 0 ? "(modified)" : "");
+  int status_length;
+  int right_status_length;
 
-  int right_status_length =
-      snprintf(right_status, sizeof(right_status), "%d/%d",
-               cursor_position.y + 1, (int)lines.size());
+  if (buffer->is_hex_view()) {
+    std::size_t offset =
+        (std::size_t)viewport->cursor_position.y * HEX_VIEW_BYTES_PER_ROW +
+        viewport->cursor_position.x;
 
-  if (status_length > window->width) {
-    status_length = window->width;
+    status_length =
+        snprintf(left_status, sizeof(left_status), "%.20s - %zu bytes | hex",
+                 buffer->filename.c_str(), buffer->hex_view->get_size());
+    right_status_length =
+        snprintf(right_status, sizeof(right_status), "0x%zx/0x%zx", offset,
+                 buffer->hex_view->get_size());
+  } else {
+    status_length =
+        snprintf(left_status, sizeof(left_status), "%.20s - %d lines | %s%s",
+                 buffer->get_display_name().c_str(),
+                 (int)buffer->lines.size(),
+                 buffer->edits_count > 0 ? "(modified)" : "",
+                 buffer->changed_on_disk ? " (changed on disk)" : "");
+    right_status_length =
+        snprintf(right_status, sizeof(right_status), "%d/%d",
+                 (int)viewport->cursor_position.y + 1,
+                 (int)buffer->lines.size());
+  }
+
+  if (status_length > viewport->width) {
+    status_length = viewport->width;
   }
 
   std::string left_status_line{left_status};
   left_status_line.resize(status_length);
-  screen_buffer->append(left_status_line);
+  content.append(left_status_line);
 
-  while (status_length < window->width) {
-    if (window->width - status_length == right_status_length) {
+  while (status_length < viewport->width) {
+    if (viewport->width - status_length == right_status_length) {
       std::string right_status_line{right_status};
       right_status_line.resize(right_status_length);
-      screen_buffer->append(right_status_line);
+      content.append(right_status_line);
       break;
     } else {
-      screen_buffer->append(" ");
+      content.append(" ");
       status_length++;
     }
   }
 
-  screen_buffer->append(escape_map["normal_colors"]);
-  screen_buffer->append("\r\n");
+  content.append(escape_map["normal_colors"]);
+  frame_composer->put(viewport->top + viewport->height, viewport->left,
+                      content);
 }
 
 void Editor::set_status_message(const char* formatted_string, ...) {
@@ -512,7 +1330,7 @@ void Editor::set_status_message(const char* formatted_string, ...) {
 }
 
 void Editor::draw_message_bar() {
-  screen_buffer->append(escape_map["clear_line"]);
+  std::string content;
 
   int message_length = strlen(status_message.contents);
 
@@ -521,19 +1339,26 @@ void Editor::draw_message_bar() {
   }
 
   if (message_length && time(NULL) - status_message.timestamp < 5) {
-    screen_buffer->append(status_message.contents);
+    content.append(status_message.contents, message_length);
   }
+
+  content.resize(window->width, ' ');
+  frame_composer->put(window->height + 1, 0, content);
 }
 
 void Editor::insert_character(int character) {
-  int column_number = cursor_position.x;
-  int line_number = cursor_position.y;
+  if (!is_buffer_ready()) {
+    return;
+  }
 
-  if (line_number >= (int)lines.size()) {
-    lines.push_back("");
+  int column_number = viewport->cursor_position.x;
+  int line_number = viewport->cursor_position.y;
+
+  if (line_number >= (int)buffer->lines.size()) {
+    buffer->insert_line(buffer->lines.size(), "");
   }
 
-  std::string& line = lines.at(line_number);
+  std::pmr::string& line = buffer->edit_line(line_number);
 
   if (column_number < 0 || column_number > (int)line.length()) {
     column_number = line.length();
@@ -541,56 +1366,106 @@ void Editor::insert_character(int character) {
 
   line.insert(column_number, 1, character);
 
-  draw_line(line_number);
-
-  cursor_position.x++;
-  edits_count++;
+  viewport->cursor_position.x++;
+  buffer->edits_count++;
 }
 
-void Editor::save_file() {
-  if (filename.length() == 0) {
-    filename = prompt("Save file as: %s");
+// Refuses to overwrite changes another program made to the file, unless
+// forced to
+void Editor::save_file(bool force) {
+  if (!is_buffer_ready()) {
+    return;
+  }
 
-    if (filename.length() == 0) {
-      set_status_message("Save operation cancelled");
-      return;
-    }
+  if (buffer->is_saving()) {
+    set_status_message("%s is already being saved", buffer->filename.c_str());
+    return;
   }
 
-  std::ofstream file;
+  if (!force && (buffer->changed_on_disk || buffer->has_changed_on_disk())) {
+    buffer->changed_on_disk = true;
+    set_status_message("%s changed on disk! Use diff, reload, or save! to "
+                       "overwrite",
+                       buffer->filename.c_str());
+    return;
+  }
 
-  try {
-    file.open(filename, std::ios_base::out);
+  if (buffer->filename.length() == 0) {
+    buffer->filename = resolve_path(prompt("Save file as: %s"));
 
-    for (unsigned int i = 0; i < lines.size(); i++) {
-      file << lines[i] << "\n";
+    if (buffer->filename.length() == 0) {
+      set_status_message("Save operation cancelled");
+      return;
     }
 
-    file.close();
+    file_watcher->watch(buffer->filename);
+  }
 
-    set_status_message("%d bytes to written to disk",
-                       lines.size() * sizeof(lines[0]));
+  // The file is written from a snapshot, so editing can go on meanwhile
+  Buffer* target = buffer;
+  std::shared_ptr<LineSnapshot> lines =
+      std::make_shared<LineSnapshot>(target->begin_save(file_resource.get()));
+  // Nothing is copied from a file known to have changed since it was read,
+  // which is what save! overwrites
+  int source_fd =
+      target->changed_on_disk || target->has_changed_on_disk()
+          ? -1
+          : target->duplicate_file_descriptor();
+  FileStamp source_stamp = target->get_disk_stamp();
+  uint64_t saved_change_count = target->lines.get_change_count();
+  std::string filename = target->filename;
+
+  target->pending_tasks++;
+  set_status_message("Saving %s...", filename.c_str());
+
+  task_scheduler->submit(TaskPriority::Interactive, [this, target, lines,
+                                                     source_fd, source_stamp,
+                                                     saved_change_count,
+                                                     filename]() {
+    SaveStatistics statistics;
+    std::string error;
+
+    try {
+      statistics =
+          Buffer::write_lines(filename, *lines, source_fd, source_stamp);
+    } catch (const std::exception& e) {
+      error = e.what();
+    }
 
-    edits_count = 0;
+    task_scheduler->post(
+        [this, target, saved_change_count, statistics, error]() {
+          if (error.empty()) {
+            target->finish_save(saved_change_count);
+            set_status_message("%ld bytes written to disk (%ld reused)",
+                               (long)statistics.written_bytes,
+                               (long)statistics.reused_bytes);
+          } else {
+            target->abort_save();
+            set_status_message("Could not save file. I/O error: %s",
+                               error.c_str());
+          }
 
-  } catch (const std::exception& e) {
-    set_status_message("Could not save file. I/O error: %s", e.what());
-    file.close();
-  }
+          target->pending_tasks--;
+        });
+  });
 }
 
 void Editor::delete_character() {
-  int line_number = cursor_position.y;
-  int column_number = cursor_position.x;
-  std::string& line = lines[line_number];
+  if (!is_buffer_ready()) {
+    return;
+  }
 
-  if (line_number == (int)lines.size()) {
+  int line_number = viewport->cursor_position.y;
+  int column_number = viewport->cursor_position.x;
+  if (line_number == (int)buffer->lines.size()) {
     return;
   }
 
+  std::string_view line = buffer->lines[line_number];
+
   if (column_number > 0) {
-    line.erase(column_number - 1, 1);
-    cursor_position.x--;
+    buffer->edit_line(line_number).erase(column_number - 1, 1);
+    viewport->cursor_position.x--;
   } else if (column_number == 0) { // First column
 
     // On first line
@@ -602,48 +1477,56 @@ void Editor::delete_character() {
     if (line.empty()) {
       // If empty, remove line
       move_cursor(EditorKey::Left);
-      lines.erase(lines.begin() + line_number);
+      buffer->erase_line(line_number);
     } else {
       // If not empty, append current line to previous line
-      std::string& previous_line = lines[line_number - 1];
-
-      previous_line.append(line);
+      buffer->edit_line(line_number - 1).append(line);
       move_cursor(EditorKey::Left);
-      cursor_position.x -= line.length();
-      lines.erase(lines.begin() + line_number);
+      viewport->cursor_position.x -= line.length();
+      buffer->erase_line(line_number);
     }
   }
 
-  edits_count++;
+  buffer->edits_count++;
 }
 
 void Editor::insert_newline() {
-  if (lines.empty()) {
-    lines.push_back("");
+  if (!is_buffer_ready()) {
     return;
   }
 
-  std::string& current_line = lines[cursor_position.y];
+  if (buffer->lines.empty()) {
+    buffer->insert_line(0, "");
+    buffer->edits_count++;
+    return;
+  }
+
+  std::string_view current_line = buffer->lines[viewport->cursor_position.y];
 
   if (current_line.empty()) {
-    lines.push_back("");
-    cursor_position.x = 0;
-    cursor_position.y++;
+    buffer->insert_line(buffer->lines.size(), "");
+    viewport->cursor_position.x = 0;
+    viewport->cursor_position.y++;
   } else {
-    if (cursor_position.x == 0) {
-      lines.insert(lines.begin() + cursor_position.y, 1, "");
-      cursor_position.y++;
+    if (viewport->cursor_position.x == 0) {
+      buffer->insert_line(viewport->cursor_position.y, "");
+      viewport->cursor_position.y++;
     } else {
-      std::string text = current_line.substr(cursor_position.x);
-      current_line.erase(cursor_position.x);
-      lines.insert(lines.begin() + cursor_position.y + 1, text);
-      cursor_position.x = 0;
-      cursor_position.y++;
+      std::string text{current_line.substr(viewport->cursor_position.x)};
+      buffer->edit_line(viewport->cursor_position.y)
+          .erase(viewport->cursor_position.x);
+      buffer->insert_line(viewport->cursor_position.y + 1, text);
+      viewport->cursor_position.x = 0;
+      viewport->cursor_position.y++;
     }
   }
+
+  buffer->edits_count++;
 }
 
-std::string Editor::prompt(const std::string& message) {
+// When `cancelled` is given, an empty input may be confirmed and cancelling is
+// reported through it instead of only by the empty result
+std::string Editor::prompt(const std::string& message, bool* cancelled) {
   std::string input{""};
 
   while (true) {
@@ -658,10 +1541,16 @@ std::string Editor::prompt(const std::string& message) {
         input.pop_back();
       }
     } else if (key == '\x1b') {
+      if (cancelled != nullptr) {
+        *cancelled = true;
+      }
       set_status_message("");
       return "";
     } else if (key == '\r') {
-      if (input.length() != 0) {
+      if (input.length() != 0 || cancelled != nullptr) {
+        if (cancelled != nullptr) {
+          *cancelled = false;
+        }
         set_status_message("");
         return input;
       }
@@ -672,7 +1561,13 @@ std::string Editor::prompt(const std::string& message) {
 }
 
 void Editor::search() {
-  search_occurences.clear();
+  if (!is_buffer_ready()) {
+    return;
+  }
+
+  // A new search replaces the one that may still be running
+  buffer->search_cancellation.cancel();
+  buffer->search_results = nullptr;
 
   std::string query = prompt("Search: %s (Press ESC to cancel)");
 
@@ -680,23 +1575,503 @@ void Editor::search() {
     return;
   }
 
-  unsigned int line_number = 0;
-  do {
-    const std::string& line = lines[line_number];
+  buffer->search_cancellation = buffer->cancellation.derive();
+
+  Buffer* target = buffer;
+  CancellationToken token = target->search_cancellation;
+  std::shared_ptr<LineSnapshot> lines =
+      std::make_shared<LineSnapshot>(target->lines.snapshot(&search_resource));
+
+  target->pending_tasks++;
+
+  task_scheduler->submit(TaskPriority::Interactive, [this, target, token,
+                                                     lines, query]() {
+    std::shared_ptr<SearchResults> results =
+        std::make_shared<SearchResults>(&search_resource);
+    int reported_percent = 0;
+
+    for (std::size_t block = 0; block < lines->size() && !token.is_cancelled();
+         block += KILO_SEARCH_BLOCK_LINES) {
+      std::size_t block_end =
+          std::min<std::size_t>(lines->size(), block + KILO_SEARCH_BLOCK_LINES);
+
+      for (std::size_t line_number = block; line_number < block_end;
+           line_number++) {
+        std::size_t result_index = (*lines)[line_number].find(query);
+
+        if (result_index != std::string::npos) {
+          results->occurences.push_back(
+              SearchOccurence{static_cast<unsigned int>(result_index),
+                              static_cast<unsigned int>(line_number)});
+        }
+      }
+
+      int percent = 100 * block_end / lines->size();
+
+      if (block_end < lines->size() && percent != reported_percent) {
+        reported_percent = percent;
+        task_scheduler->post([this, token, percent]() {
+          if (!token.is_cancelled() && !awaiting_user_choice) {
+            set_status_message("Searching... %d%%", percent);
+          }
+        });
+      }
+    }
+
+    task_scheduler->post([this, target, token, query,
+                          results = std::move(results)]() mutable {
+      if (!token.is_cancelled()) {
+        target->search_results = std::move(results);
+        target->current_occurence_index = 0;
+
+        set_status_message("%zu occurences of \"%s\" found",
+                           target->get_occurence_count(), query.c_str());
+
+        if (target->get_occurence_count() > 0 && viewport->buffer == target) {
+          viewport->cursor_position.x =
+              target->search_results->occurences[0][0];
+          viewport->cursor_position.y =
+              target->search_results->occurences[0][1];
+        }
+      }
+
+      target->pending_tasks--;
+    });
+  });
+}
+
+// Searches a hex view for a byte pattern, starting at the cursor
+void Editor::search_bytes() {
+  std::string input =
+      prompt("Search bytes: %s (hex or \"text\", Press ESC to cancel)");
+
+  if (input.length() == 0) {
+    return;
+  }
+
+  if (!parse_byte_pattern(input, buffer->search_pattern)) {
+    set_status_message("Invalid byte pattern: %s", input.c_str());
+    return;
+  }
+
+  find_bytes(get_cursor_offset(), true);
+}
+
+// Moves the cursor to the next match of the buffer's byte pattern, searching
+// in the background since the file may be large
+void Editor::find_bytes(std::size_t from, bool forward) {
+  if (buffer->search_pattern.empty()) {
+    return;
+  }
+
+  buffer->search_cancellation.cancel();
+  buffer->search_cancellation = buffer->cancellation.derive();
+
+  Buffer* target = buffer;
+  CancellationToken token = target->search_cancellation;
+  std::shared_ptr<const HexView> hex_view = target->hex_view;
+  std::string pattern = target->search_pattern;
+
+  target->pending_tasks++;
+
+  task_scheduler->submit(TaskPriority::Interactive, [this, target, token,
+                                                     hex_view, pattern, from,
+                                                     forward]() {
+    int reported_percent = 0;
+
+    std::size_t match = hex_view->find(
+        pattern, from, forward, token, [&](int percent) {
+          if (percent == reported_percent) {
+            return;
+          }
+
+          reported_percent = percent;
+          task_scheduler->post([this, token, percent]() {
+            if (!token.is_cancelled() && !awaiting_user_choice) {
+              set_status_message("Searching... %d%%", percent);
+            }
+          });
+        });
+
+    task_scheduler->post([this, target, token, hex_view, match]() {
+      if (!token.is_cancelled()) {
+        if (match == std::string::npos) {
+          set_status_message("Pattern not found");
+        } else {
+          set_status_message("Found at 0x%zx", match);
+
+          if (viewport->buffer == target && target->hex_view == hex_view) {
+            set_cursor_offset(match);
+          }
+        }
+      }
+
+      target->pending_tasks--;
+    });
+  });
+}
+
+std::size_t Editor::get_cursor_offset() {
+  return (std::size_t)viewport->cursor_position.y * HEX_VIEW_BYTES_PER_ROW +
+         viewport->cursor_position.x;
+}
+
+void Editor::set_cursor_offset(std::size_t offset) {
+  viewport->cursor_position.y = offset / HEX_VIEW_BYTES_PER_ROW;
+  viewport->cursor_position.x = offset % HEX_VIEW_BYTES_PER_ROW;
+}
+
+// Switches the buffer between text and hex view
+void Editor::toggle_hex_view() {
+  if (buffer->is_hex_view()) {
+    buffer->leave_hex_view();
+    viewport->cursor_position = CursorPosition{0, 0};
+    load_buffer(buffer);
+    return;
+  }
+
+  if (!is_buffer_ready()) {
+    return;
+  }
+
+  if (buffer->is_modified() || buffer->pending_tasks > 0) {
+    set_status_message("Save the buffer before viewing it as hex");
+    return;
+  }
+
+  buffer->enter_hex_view();
+  viewport->cursor_position = CursorPosition{0, 0};
+}
+
+// Jumps to a byte offset in hex view, or to a line number otherwise
+void Editor::go_to(const std::string& argument) {
+  char* end = nullptr;
+  unsigned long long target = strtoull(argument.c_str(), &end, 0);
+
+  if (argument.empty() || *end != '\0') {
+    set_status_message("Invalid position: %s", argument.c_str());
+    return;
+  }
+
+  if (buffer->is_hex_view()) {
+    std::size_t size = buffer->hex_view->get_size();
+    set_cursor_offset(size == 0 ? 0 : std::min<std::size_t>(target, size - 1));
+  } else {
+    viewport->cursor_position.y =
+        std::min<unsigned long long>(target > 0 ? target - 1 : 0,
+                                     buffer->lines.size());
+    viewport->cursor_position.x = 0;
+  }
+}
+
+// Makes text safe to paste into a printf format, such as a prompt's message
+static std::string escape_format(const std::string& text) {
+  std::string escaped;
+
+  for (char c : text) {
+    if (c == '%') {
+      escaped.push_back('%');
+    }
+
+    escaped.push_back(c);
+  }
+
+  return escaped;
+}
+
+static std::size_t replace_in_line(std::string_view line,
+                                   const std::string& query,
+                                   const std::string& replacement,
+                                   std::string& result) {
+  std::size_t match_index = line.find(query);
+
+  if (match_index == std::string::npos) {
+    return 0;
+  }
+
+  // Build the new line in a single pass instead of shifting the tail of the
+  // line once per match
+  result.clear();
+  result.reserve(line.length());
+
+  std::size_t copied_until = 0;
+  std::size_t match_count = 0;
+
+  while (match_index != std::string::npos) {
+    result.append(line.substr(copied_until, match_index - copied_until));
+    result.append(replacement);
+    copied_until = match_index + query.length();
+    match_count++;
+    match_index = line.find(query, copied_until);
+  }
+
+  result.append(line.substr(copied_until));
+
+  return match_count;
+}
+
+void Editor::replace_all() {
+  if (!is_buffer_ready()) {
+    return;
+  }
+
+  std::string query = prompt("Replace: %s (Press ESC to cancel)");
+
+  if (query.length() == 0) {
+    return;
+  }
+
+  bool cancelled = false;
+  std::string replacement =
+      prompt("Replace \"" + escape_format(query) +
+                 "\" with: %s (Press ESC to cancel)",
+             &cancelled);
+
+  if (cancelled) {
+    set_status_message("Replace operation cancelled");
+    return;
+  }
+
+  // Each chunk of lines is scanned by its own thread, which only builds the
+  // replaced lines; the line store is not thread safe for writing, so they are
+  // stored afterwards
+  std::vector<std::size_t> match_counts(
+      parallel_chunk_count(buffer->lines.size()));
+  std::vector<std::vector<std::pair<std::size_t, std::string>>> modified_lines(
+      match_counts.size());
+
+  parallel_for(buffer->lines.size(), [&](std::size_t begin, std::size_t end,
+                                         std::size_t chunk) {
+    std::string result;
+
+    for (std::size_t line_number = begin; line_number < end; line_number++) {
+      std::size_t line_matches = replace_in_line(
+          buffer->lines[line_number], query, replacement, result);
+
+      if (line_matches > 0) {
+        match_counts[chunk] += line_matches;
+        modified_lines[chunk].emplace_back(line_number, result);
+      }
+    }
+  });
+
+  std::size_t match_count = 0;
+  std::size_t line_count = 0;
+
+  for (std::size_t chunk = 0; chunk < match_counts.size(); chunk++) {
+    match_count += match_counts[chunk];
+    line_count += modified_lines[chunk].size();
 
-    std::size_t result_index = line.find(query);
-    if (result_index != std::string::npos) {
-      std::vector<unsigned int> occurence{
-          static_cast<unsigned int>(result_index), line_number};
-      search_occurences.push_back(occurence);
+    for (const auto& [line_number, text] : modified_lines[chunk]) {
+      buffer->edit_line(line_number).assign(text);
     }
+  }
+
+  if (match_count == 0) {
+    set_status_message("No occurences of \"%s\" found", query.c_str());
+    return;
+  }
+
+  // Previous search results point into text that no longer exists
+  buffer->search_cancellation.cancel();
+  buffer->search_results = nullptr;
+  buffer->current_occurence_index = 0;
+
+  if (viewport->cursor_position.y < (int)buffer->lines.size() &&
+      viewport->cursor_position.x >
+          (int)buffer->lines[viewport->cursor_position.y].length()) {
+    viewport->cursor_position.x =
+        buffer->lines[viewport->cursor_position.y].length();
+  }
+
+  buffer->edits_count++;
+  set_status_message("Replaced %zu occurences on %zu lines", match_count,
+                     line_count);
+}
+
+// Commands have the form "[first,last] name [argument]", where the optional
+// 1-based, inclusive line range defaults to the whole buffer
+void Editor::execute_command() {
+  std::string input = prompt("Command: %s (Press ESC to cancel)");
+
+  if (input.length() == 0) {
+    return;
+  }
 
-    line_number++;
-  } while (line_number != lines.size());
+  std::size_t begin = 0;
+  std::size_t end = buffer->lines.size();
+  unsigned long first_line = 0;
+  unsigned long last_line = 0;
+  int range_length = 0;
+
+  if (sscanf(input.c_str(), "%lu,%lu %n", &first_line, &last_line,
+             &range_length) == 2 &&
+      range_length > 0) {
+    if (first_line == 0 || first_line > last_line) {
+      set_status_message("Invalid line range");
+      return;
+    }
 
-  if (search_occurences.size() > 0) {
-    cursor_position.x = search_occurences[0][0];
-    cursor_position.y = search_occurences[0][1];
-    current_occurence_index = 0;
+    begin = std::min<std::size_t>(first_line - 1, buffer->lines.size());
+    end = std::min<std::size_t>(last_line, buffer->lines.size());
+    input.erase(0, range_length);
   }
+
+  std::size_t separator_index = input.find(' ');
+  std::string command = input.substr(0, separator_index);
+  std::string argument =
+      separator_index == std::string::npos ? ""
+                                           : input.substr(separator_index + 1);
+
+  if (command == "sort" || command == "nsort" || command == "uniq" ||
+      command == "keep" || command == "drop" || command == "reverse") {
+    transform_lines(command, argument, begin, end);
+  } else if (command == "buffers") {
+    list_buffers();
+  } else if (command == "buffer" || command == "open") {
+    try {
+      if (command == "open") {
+        open(resolve_path(argument));
+      } else {
+        view_buffer(atoi(argument.c_str()) - 1);
+      }
+    } catch (const std::exception& e) {
+      set_status_message("%s", e.what());
+    }
+  } else if (command == "close" || command == "close!") {
+    close_buffer(command == "close!");
+  } else if (command == "split" || command == "vsplit") {
+    split_viewport(command == "vsplit");
+  } else if (command == "unsplit") {
+    close_viewport();
+  } else if (command == "frames") {
+    const FrameStatistics& statistics = frame_scheduler->get_statistics();
+    set_status_message("Frames: %lu rendered, %lu coalesced, %lu dropped | "
+                       "Limit: %d fps",
+                       statistics.rendered, statistics.coalesced,
+                       statistics.dropped,
+                       frame_scheduler->get_max_frames_per_second());
+  } else if (command == "save" || command == "save!") {
+    save_file(command == "save!");
+  } else if (command == "reload") {
+    if (buffer->filename.empty()) {
+      set_status_message("Buffer has no file to reload");
+    } else if (buffer->is_saving()) {
+      set_status_message("%s is being saved", buffer->filename.c_str());
+    } else {
+      reload_buffer(buffer);
+    }
+  } else if (command == "diff") {
+    diff_buffer();
+  } else if (command == "hex") {
+    try {
+      toggle_hex_view();
+    } catch (const std::exception& e) {
+      set_status_message("%s", e.what());
+    }
+  } else if (command == "goto") {
+    go_to(argument);
+  } else if (command == "memory") {
+    show_memory_usage();
+  } else if (command == "storage") {
+    LineStoreStatistics statistics = buffer->lines.get_statistics();
+    std::size_t overhead_bytes =
+        statistics.table_bytes + statistics.side_slot_bytes;
+
+    set_status_message(
+        "%zu lines | %zu KB file | %zu KB table | %zu in slots (%zu KB) | "
+        "%.1f B/line",
+        statistics.line_count, statistics.file_bytes >> 10,
+        statistics.table_bytes >> 10, statistics.side_slot_count,
+        statistics.side_slot_bytes >> 10,
+        statistics.line_count > 0
+            ? (double)overhead_bytes / statistics.line_count
+            : 0.0);
+  } else if (command == "shutdown" || command == "shutdown!") {
+    bool has_unsaved_changes =
+        std::any_of(buffers.begin(), buffers.end(),
+                    [](const std::unique_ptr<Buffer>& open_buffer) {
+                      return open_buffer->is_modified();
+                    });
+
+    if (server == nullptr) {
+      set_status_message("Not running as a daemon, use ^Q to quit");
+    } else if (has_unsaved_changes && command == "shutdown") {
+      set_status_message("There are unsaved changes, use shutdown! to discard "
+                         "them");
+    } else {
+      shutdown_requested = true;
+      session_ended = true;
+    }
+  } else if (command == "fps") {
+    frame_scheduler->set_max_frames_per_second(atoi(argument.c_str()));
+    set_status_message("Frame rate limit set to %d fps",
+                       frame_scheduler->get_max_frames_per_second());
+  } else {
+    set_status_message("Unknown command: %s", command.c_str());
+  }
+}
+
+void Editor::transform_lines(const std::string& command,
+                             const std::string& argument, std::size_t begin,
+                             std::size_t end) {
+  if (!is_buffer_ready()) {
+    return;
+  }
+
+  LineOrder order;
+
+  if (command == "sort" || command == "nsort") {
+    order = sort_lines(buffer->lines, begin, end, command == "nsort",
+                       [&](int percent) {
+                         set_status_message("Sorting lines... %d%%", percent);
+                         refresh_screen();
+                       });
+  } else if (command == "uniq") {
+    order = unique_lines(buffer->lines, begin, end);
+  } else if (command == "keep" || command == "drop") {
+    if (argument.length() == 0) {
+      set_status_message("Usage: %s <text>", command.c_str());
+      return;
+    }
+
+    order = filter_lines(buffer->lines, begin, end, argument,
+                         command == "keep");
+  } else if (command == "reverse") {
+    order = reverse_lines(begin, end);
+  }
+
+  std::size_t removed_count = (end - begin) - order.size();
+
+  apply_line_order(begin, end, order);
+
+  set_status_message("%s: %zu lines, %zu removed", command.c_str(),
+                     end - begin, removed_count);
+}
+
+// Moves the lines listed in `order` into [begin, end), dropping the ones that
+// are not listed. Lines keep their contents and on-disk origin, so only their
+// table entries are shuffled.
+void Editor::apply_line_order(std::size_t begin, std::size_t end,
+                              const LineOrder& order) {
+  buffer->lines.reorder(begin, end, order);
+  buffer->invalidate_rendered_lines();
+
+  buffer->search_cancellation.cancel();
+  buffer->search_results = nullptr;
+  buffer->current_occurence_index = 0;
+
+  if (viewport->cursor_position.y > (int)buffer->lines.size()) {
+    viewport->cursor_position.y = buffer->lines.size();
+  }
+
+  int line_length = viewport->cursor_position.y < (int)buffer->lines.size()
+                        ? buffer->lines[viewport->cursor_position.y].length()
+                        : 0;
+
+  if (viewport->cursor_position.x > line_length) {
+    viewport->cursor_position.x = line_length;
+  }
+
+  buffer->edits_count++;
 }
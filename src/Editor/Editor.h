@@ -21,24 +21,34 @@
 
 #include "../Terminal/Terminal.h"
 #include "../AppendBuffer/AppendBuffer.h"
+#include "../FileWriter/FileWriter.h"
+#include "../Parallel/Parallel.h"
+#include "../LineTransforms/LineTransforms.h"
+#include "../FrameScheduler/FrameScheduler.h"
+#include "../Arena/Arena.h"
+#include "../Buffer/Buffer.h"
+#include "../Layout/Layout.h"
+#include "../FrameComposer/FrameComposer.h"
+#include "../TaskScheduler/TaskScheduler.h"
+#include "../FileWatcher/FileWatcher.h"
+#include "../Server/Server.h"
+#include "../MemoryAccount/MemoryAccount.h"
 
 #define KILO_VERSION "0.0.1"
-#define KILO_TAB_STOP 4
+#define KILO_MAX_FRAMES_PER_SECOND 60
+#define KILO_MEMORY_BUDGET ((std::size_t)512 << 20)
+// Background searches check for cancellation and report progress this often
+#define KILO_SEARCH_BLOCK_LINES (1 << 16)
 
 #define CTRL_KEY(key) (key) & 0x1f;
 
-typedef std::map<std::string, std::string> EscapeMap;
+typedef std::pmr::map<std::pmr::string, std::pmr::string> EscapeMap;
 
 struct Window {
   int width;
   int height;
 };
 
-struct CursorPosition {
-  int x;
-  int y;
-};
-
 struct StatusMessage {
   char contents[80];
   time_t timestamp{0};
@@ -57,49 +67,109 @@ enum EditorKey {
   End,
 };
 
+// Edits files on one terminal at a time. Without a server, the editor runs
+// a single session on the terminal it was started from. With one, it serves
+// session after session, keeping its buffers in between.
 class Editor {
 public:
-  Editor(const std::string& filename);
+  Editor(Server* server = nullptr);
   ~Editor();
+  bool attach(const Session& session);
   void open(const std::string& filename);
 
 private:
+  Server* server{nullptr};
+  int input_fd{STDIN_FILENO};
+  int output_fd{STDOUT_FILENO};
+  int connection_fd{-1};
+  bool session_ended{false};
+  bool shutdown_requested{false};
+  // Declared first, everything allocated from them must be gone before them
+  MemoryAccount buffer_memory{"buffers"};
+  MemoryAccount render_memory{"render"};
+  MemoryAccount search_memory{"search"};
+  TrackingResource render_resource{&render_memory};
+  TrackingResource search_resource{&search_memory};
   std::unique_ptr<Terminal> terminal{nullptr};
   std::unique_ptr<AppendBuffer> screen_buffer{nullptr};
+  std::unique_ptr<FrameScheduler> frame_scheduler{nullptr};
+  std::unique_ptr<FrameComposer> frame_composer{nullptr};
   Window* window{nullptr};
-  CursorPosition cursor_position;
-  EscapeMap escape_map;
+  EscapeMap escape_map{&render_resource};
   StatusMessage status_message;
-  std::vector<std::string> lines;
-  int vertical_scroll_offset;
-  int horizontal_scroll_offset;
-  std::string filename;
-  int edits_count;
+  std::unique_ptr<Arena> arena{nullptr};
+  // File contents are shared with the tasks that read them, so they come
+  // from here rather than from the pool of their buffer
+  std::unique_ptr<TrackingResource> file_resource{nullptr};
+  std::vector<std::unique_ptr<Buffer>> buffers;
+  // Declared after the buffers, so that it is stopped before they go away
+  std::unique_ptr<TaskScheduler> task_scheduler{nullptr};
+  std::unique_ptr<FileWatcher> file_watcher{nullptr};
+  std::unique_ptr<Layout> layout{nullptr};
+  Viewport* viewport{nullptr};
+  Buffer* buffer{nullptr};
+  unsigned long view_count{0};
   bool awaiting_user_choice;
-  std::vector<std::vector<unsigned int>> search_occurences;
-  int current_occurence_index;
 
   int read_key();
   Window* create_window();
   CursorPosition get_cursor_position();
   void initialize();
+  void run();
+  void open_files(const std::vector<std::string>& filenames);
+  std::unique_ptr<Buffer> create_buffer(const std::string& filename);
+  std::size_t find_buffer(const std::string& filename) const;
+  std::string resolve_path(const std::string& filename) const;
+  bool is_terminal_closed() const;
   void refresh_screen();
-  void draw();
-  void draw_line(int line_number);
-  void draw_status_bar();
+  void draw_viewport(Viewport* viewport);
+  void draw_hex_viewport(Viewport* viewport);
+  void draw_status_bar(Viewport* viewport);
   void draw_message_bar();
   void set_status_message(const char* formatted_string, ...);
   void process_input();
-  void display_welcome_message();
+  std::string welcome_message(int width);
   void move_cursor(int key);
-  void scroll();
-  void replace_tabs_with_spaces(int line_number);
+  void scroll(Viewport* viewport);
+  int get_cursor_column(Viewport* viewport);
+  void move_hex_cursor(int key);
   void insert_character(int character);
   void delete_character();
   void insert_newline();
-  void save_file();
-  std::string prompt(const std::string& message);
+  void save_file(bool force = false);
+  std::string prompt(const std::string& message, bool* cancelled = nullptr);
+  void load_buffer(Buffer* target);
+  bool is_buffer_ready();
+  void stop_background_tasks();
+  void wait_for_tasks(Buffer* target);
+  void clamp_cursors(Buffer* target);
+  void check_files_on_disk(bool check_all = false);
+  void reload_buffer(Buffer* target);
+  void diff_buffer();
+  void show_scratch(const std::string& name,
+                    const std::vector<std::string>& contents);
+  void view_buffer(std::size_t index);
+  void focus_viewport(Viewport* next_viewport);
+  void focus_next_viewport();
+  void split_viewport(bool side_by_side);
+  void close_viewport();
+  void close_buffer(bool discard_changes);
+  void evict_idle_buffers();
+  void list_buffers();
+  void show_memory_usage();
   void search();
+  void search_bytes();
+  void find_bytes(std::size_t from, bool forward);
+  std::size_t get_cursor_offset();
+  void set_cursor_offset(std::size_t offset);
+  void toggle_hex_view();
+  void go_to(const std::string& argument);
+  void replace_all();
+  void execute_command();
+  void transform_lines(const std::string& command, const std::string& argument,
+                       std::size_t begin, std::size_t end);
+  void apply_line_order(std::size_t begin, std::size_t end,
+                        const LineOrder& order);
 };
 
 #endif // !EDITOR_H
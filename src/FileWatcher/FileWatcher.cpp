@@ -0,0 +1,114 @@
+#include "FileWatcher.h"
+
+#define FILE_WATCHER_EVENT_MASK                                                \
+  (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE | IN_MOVED_FROM |      \
+   IN_ATTRIB)
+
+// The canonical path of the directory a file is in, ending in '/', or an
+// empty string when it cannot be resolved
+static std::string get_canonical_directory(const std::string& filename) {
+  std::size_t separator_index = filename.find_last_of('/');
+  std::string directory = separator_index == std::string::npos
+                              ? "."
+                              : filename.substr(0, separator_index + 1);
+  char resolved_path[PATH_MAX];
+
+  if (realpath(directory.c_str(), resolved_path) == nullptr) {
+    return "";
+  }
+
+  std::string canonical_directory{resolved_path};
+
+  if (canonical_directory.back() != '/') {
+    canonical_directory.push_back('/');
+  }
+
+  return canonical_directory;
+}
+
+// Spells a file's path the way changes to it are reported: through the
+// canonical path of its directory. The file itself may be a symbolic link or
+// not exist yet. Paths whose directory cannot be resolved are kept as given.
+std::string canonicalize_path(const std::string& filename) {
+  std::string directory = get_canonical_directory(filename);
+
+  if (directory.length() == 0) {
+    return filename;
+  }
+
+  return directory + filename.substr(filename.find_last_of('/') + 1);
+}
+
+FileWatcher::FileWatcher() {
+  file_descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+  if (file_descriptor == -1) {
+    throw std::runtime_error{"FileWatcher: could not initialize inotify"};
+  }
+}
+
+FileWatcher::~FileWatcher() {
+  close(file_descriptor);
+}
+
+// Watching is best effort, a file in a directory that cannot be watched is
+// still checked against its stamp before being saved
+void FileWatcher::watch(const std::string& filename) {
+  if (filename.length() == 0) {
+    return;
+  }
+
+  std::string directory = get_canonical_directory(filename);
+
+  if (directory.length() == 0 || watches.count(directory) > 0) {
+    return;
+  }
+
+  int watch_descriptor = inotify_add_watch(
+      file_descriptor, directory.c_str(), FILE_WATCHER_EVENT_MASK);
+
+  if (watch_descriptor == -1) {
+    return;
+  }
+
+  watches[directory] = watch_descriptor;
+  directories[watch_descriptor].push_back(directory);
+}
+
+// Returns the canonicalized paths of the files that changed since the last
+// call. Paths may repeat.
+std::vector<std::string> FileWatcher::read_changes() {
+  std::vector<std::string> changes;
+  alignas(struct inotify_event) char events[4096];
+
+  while (true) {
+    ssize_t num_bytes_read = read(file_descriptor, events, sizeof(events));
+
+    if (num_bytes_read == -1 && errno == EINTR) {
+      continue;
+    }
+
+    if (num_bytes_read <= 0) {
+      break;
+    }
+
+    for (char* position = events; position < events + num_bytes_read;) {
+      const struct inotify_event* event = (struct inotify_event*)position;
+      auto watched_directories = directories.find(event->wd);
+
+      if (watched_directories != directories.end() && event->len > 0) {
+        for (const std::string& directory : watched_directories->second) {
+          changes.push_back(directory + event->name);
+        }
+      }
+
+      position += sizeof(struct inotify_event) + event->len;
+    }
+  }
+
+  return changes;
+}
+
+int FileWatcher::get_notification_fd() const {
+  return file_descriptor;
+}
@@ -0,0 +1,39 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdexcept>
+#include <climits>
+#include <cstdlib>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/inotify.h>
+
+std::string canonicalize_path(const std::string& filename);
+
+// Watches open files for changes made by other programs. The directories
+// containing the files are watched rather than the files themselves, since
+// most programs save by renaming a new file over the old one, which a watch
+// on the old file would never see. Directories are known by their canonical
+// path, so one reached through different spellings is watched only once.
+class FileWatcher {
+public:
+  FileWatcher();
+  ~FileWatcher();
+
+  void watch(const std::string& filename);
+  std::vector<std::string> read_changes();
+  int get_notification_fd() const;
+
+private:
+  int file_descriptor{-1};
+  // Canonical directories, ending in '/', by watch descriptor and back. The
+  // same directory can still have several canonical paths, through bind
+  // mounts, in which case they share a watch descriptor.
+  std::unordered_map<int, std::vector<std::string>> directories;
+  std::unordered_map<std::string, int> watches;
+};
+
+#endif // !FILE_WATCHER_H
@@ -0,0 +1,237 @@
+#include "FileWriter.h"
+
+#define FILE_WRITER_CHUNK_SIZE (1 << 16)
+
+FileWriter::FileWriter(const std::string& path) {
+  char resolved_path[PATH_MAX];
+  struct stat target_stat;
+  struct stat link_stat;
+
+  this->path =
+      realpath(path.c_str(), resolved_path) != nullptr ? resolved_path : path;
+
+  bool target_exists = stat(this->path.c_str(), &target_stat) == 0;
+  mode_t mode = target_exists ? target_stat.st_mode & 07777 : 0666;
+
+  // A link to a file that does not exist yet creates that file
+  bool is_dangling_link = !target_exists &&
+                          lstat(this->path.c_str(), &link_stat) == 0 &&
+                          S_ISLNK(link_stat.st_mode);
+
+  // Renaming over a file with other hard links would split it from them
+  if (!is_dangling_link && (!target_exists || target_stat.st_nlink == 1)) {
+    if (!create_temporary_file(mode)) {
+      // Only a directory the user may not create files in is a reason to
+      // overwrite the target; running out of space or descriptors is not
+      if (errno != EACCES && errno != EPERM) {
+        throw std::runtime_error{"FileWriter: could not create temporary file"};
+      }
+    } else {
+      // The replacement keeps the target's owner and group, and if the user
+      // may not give it those, the target is overwritten in place instead.
+      // fchown() may clear the set-user-ID bits, so the mode comes after it.
+      if (!target_exists ||
+          (fchown(file_descriptor, target_stat.st_uid, target_stat.st_gid) !=
+               -1 &&
+           fchmod(file_descriptor, mode) != -1)) {
+        return;
+      }
+
+      close(file_descriptor);
+      file_descriptor = -1;
+      unlink(temporary_path.c_str());
+    }
+  }
+
+  open_in_place(mode);
+}
+
+FileWriter::~FileWriter() {
+  if (file_descriptor != -1) {
+    close(file_descriptor);
+  }
+
+  if (!committed && !in_place) {
+    unlink(temporary_path.c_str());
+  }
+}
+
+void FileWriter::write(std::string_view text) {
+  pending.append(text);
+  offset += text.length();
+
+  if (pending.length() >= FILE_WRITER_CHUNK_SIZE) {
+    flush();
+  }
+}
+
+void FileWriter::copy_range(int source_fd, off_t offset, off_t length) {
+  flush();
+
+  off_t remaining = length;
+  loff_t source_offset = offset;
+
+  // Lets the kernel share extents (reflink) or copy in-kernel where the
+  // filesystem supports it, instead of bouncing the bytes through userspace
+  while (remaining > 0) {
+    ssize_t num_bytes_copied = copy_file_range(
+        source_fd, &source_offset, file_descriptor, nullptr, remaining, 0);
+
+    if (num_bytes_copied == -1) {
+      if (errno == EXDEV || errno == ENOSYS || errno == EINVAL ||
+          errno == EOPNOTSUPP) {
+        fallback_copy(source_fd, source_offset, remaining);
+        break;
+      }
+
+      throw std::runtime_error{"copy_range: could not copy file range"};
+    }
+
+    if (num_bytes_copied == 0) {
+      throw std::runtime_error{"copy_range: source file is shorter than "
+                               "expected"};
+    }
+
+    remaining -= num_bytes_copied;
+  }
+
+  this->offset += length;
+  copied_bytes += length;
+}
+
+void FileWriter::commit() {
+  flush();
+
+  // What is left of a longer previous version goes away
+  if (in_place && ftruncate(file_descriptor, offset) == -1) {
+    throw std::runtime_error{"commit: could not truncate file"};
+  }
+
+  if (fsync(file_descriptor) == -1) {
+    throw std::runtime_error{"commit: could not flush file to disk"};
+  }
+
+  if (close(file_descriptor) == -1) {
+    file_descriptor = -1;
+    throw std::runtime_error{"commit: could not close file"};
+  }
+
+  file_descriptor = -1;
+
+  if (in_place) {
+    committed = true;
+    return;
+  }
+
+  if (rename(temporary_path.c_str(), path.c_str()) == -1) {
+    throw std::runtime_error{"commit: could not replace target file"};
+  }
+
+  committed = true;
+
+  // Persist the rename itself
+  std::size_t separator_index = path.find_last_of('/');
+  std::string directory =
+      separator_index == std::string::npos
+          ? "."
+          : (separator_index == 0 ? "/" : path.substr(0, separator_index));
+
+  int directory_fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+
+  if (directory_fd != -1) {
+    fsync(directory_fd);
+    close(directory_fd);
+  }
+}
+
+bool FileWriter::is_in_place() const {
+  return in_place;
+}
+
+const off_t& FileWriter::get_offset() const {
+  return offset;
+}
+
+const off_t& FileWriter::get_copied_bytes() const {
+  return copied_bytes;
+}
+
+// Keeps the temporary file in the target's directory so that the final
+// rename stays on one filesystem and is atomic
+bool FileWriter::create_temporary_file(mode_t mode) {
+  std::size_t separator_index = path.find_last_of('/');
+  std::string directory = separator_index == std::string::npos
+                              ? ""
+                              : path.substr(0, separator_index + 1);
+  std::string basename = separator_index == std::string::npos
+                             ? path
+                             : path.substr(separator_index + 1);
+
+  for (int attempt = 0; attempt < 100; attempt++) {
+    temporary_path = directory + "." + basename + ".kilo-" +
+                     std::to_string(getpid()) + "-" + std::to_string(attempt);
+
+    file_descriptor =
+        ::open(temporary_path.c_str(), O_WRONLY | O_CREAT | O_EXCL, mode);
+
+    if (file_descriptor != -1 || errno != EEXIST) {
+      break;
+    }
+  }
+
+  return file_descriptor != -1;
+}
+
+// The file is only truncated to its new length once everything was written
+void FileWriter::open_in_place(mode_t mode) {
+  file_descriptor = ::open(path.c_str(), O_WRONLY | O_CREAT, mode);
+
+  if (file_descriptor == -1) {
+    throw std::runtime_error{"FileWriter: could not open file for writing"};
+  }
+
+  in_place = true;
+}
+
+void FileWriter::flush() {
+  write_all(pending.data(), pending.length());
+  pending.clear();
+}
+
+void FileWriter::write_all(const char* data, size_t length) {
+  while (length > 0) {
+    ssize_t num_bytes_written = ::write(file_descriptor, data, length);
+
+    if (num_bytes_written == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      throw std::runtime_error{"write: could not write to file"};
+    }
+
+    data += num_bytes_written;
+    length -= num_bytes_written;
+  }
+}
+
+void FileWriter::fallback_copy(int source_fd, off_t offset, off_t length) {
+  char chunk[FILE_WRITER_CHUNK_SIZE];
+
+  while (length > 0) {
+    ssize_t num_bytes_read =
+        pread(source_fd, chunk, std::min<off_t>(length, sizeof(chunk)), offset);
+
+    if (num_bytes_read == -1 && errno == EINTR) {
+      continue;
+    }
+
+    if (num_bytes_read <= 0) {
+      throw std::runtime_error{"copy_range: could not read source file"};
+    }
+
+    write_all(chunk, num_bytes_read);
+    offset += num_bytes_read;
+    length -= num_bytes_read;
+  }
+}
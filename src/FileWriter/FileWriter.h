@@ -0,0 +1,53 @@
+#ifndef FILE_WRITER_H
+#define FILE_WRITER_H
+
+#include <string>
+#include <string_view>
+#include <algorithm>
+#include <stdexcept>
+#include <climits>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+// Writes a file atomically where it can: contents go to a temporary file next
+// to the target, which only replaces the target once it has been flushed to
+// disk. Symbolic links are followed, and the file they point to is replaced.
+// A file with other hard links, one whose owner cannot be kept, or one in a
+// directory the user cannot create files in is overwritten in place instead,
+// which is not atomic. Nothing may be copied from the target itself then. Any
+// other failure to create the temporary file fails the write.
+class FileWriter {
+public:
+  FileWriter(const std::string& path);
+  ~FileWriter();
+
+  void write(std::string_view text);
+  void copy_range(int source_fd, off_t offset, off_t length);
+  void commit();
+
+  bool is_in_place() const;
+  const off_t& get_offset() const;
+  const off_t& get_copied_bytes() const;
+
+private:
+  std::string path;
+  std::string temporary_path;
+  std::string pending;
+  int file_descriptor{-1};
+  off_t offset{0};
+  off_t copied_bytes{0};
+  bool in_place{false};
+  bool committed{false};
+
+  bool create_temporary_file(mode_t mode);
+  void open_in_place(mode_t mode);
+  void flush();
+  void write_all(const char* data, size_t length);
+  void fallback_copy(int source_fd, off_t offset, off_t length);
+};
+
+#endif // !FILE_WRITER_H
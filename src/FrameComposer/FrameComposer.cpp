@@ -0,0 +1,53 @@
+#include "FrameComposer.h"
+
+FrameComposer::FrameComposer(std::string_view cursor_position_format,
+                             std::string_view clear_screen,
+                             std::pmr::memory_resource* upstream)
+    : cursor_position_format(cursor_position_format, upstream),
+      clear_screen(clear_screen, upstream),
+      frame_arenas{std::pmr::monotonic_buffer_resource{upstream},
+                   std::pmr::monotonic_buffer_resource{upstream}},
+      frames{Segments{&frame_arenas[0]}, Segments{&frame_arenas[1]}} {}
+
+void FrameComposer::put(int row, int column, const std::string& content) {
+  frames[current_frame][{row, column}] = content;
+}
+
+// Appends the escape sequences that turn the previous frame into the current
+// one, then starts a new frame
+void FrameComposer::compose(AppendBuffer& output) {
+  Segments& segments = frames[current_frame];
+  Segments& previous_segments = frames[1 - current_frame];
+
+  if (invalidated) {
+    output.append(clear_screen);
+  }
+
+  for (const auto& [position, content] : segments) {
+    auto previous_segment = previous_segments.find(position);
+
+    if (!invalidated && previous_segment != previous_segments.end() &&
+        previous_segment->second == content) {
+      continue;
+    }
+
+    char cursor_buffer[32];
+    snprintf(cursor_buffer, sizeof(cursor_buffer),
+             cursor_position_format.c_str(), position.first + 1,
+             position.second + 1);
+
+    output.append(cursor_buffer);
+    output.append(content);
+  }
+
+  // The previous frame is not needed anymore, its arena goes to the next one
+  previous_segments.clear();
+  frame_arenas[1 - current_frame].release();
+  current_frame = 1 - current_frame;
+  invalidated = false;
+}
+
+// Forces the next frame to be drawn in full, e.g. after the layout changed
+void FrameComposer::invalidate() {
+  invalidated = true;
+}
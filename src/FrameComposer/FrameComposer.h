@@ -0,0 +1,41 @@
+#ifndef FRAME_COMPOSER_H
+#define FRAME_COMPOSER_H
+
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <cstdio>
+#include <memory_resource>
+
+#include "../AppendBuffer/AppendBuffer.h"
+
+// Builds frames out of segments, runs of text placed at a screen position,
+// and only emits the segments that differ from the previous frame. Segments
+// must cover their full width so that they overwrite whatever was there.
+//
+// A frame's segments are allocated from an arena of their own, which is
+// released all at once when the frame after next starts.
+class FrameComposer {
+public:
+  FrameComposer(
+      std::string_view cursor_position_format, std::string_view clear_screen,
+      std::pmr::memory_resource* upstream = std::pmr::get_default_resource());
+
+  void put(int row, int column, const std::string& content);
+  void compose(AppendBuffer& output);
+  void invalidate();
+
+private:
+  typedef std::pmr::map<std::pair<int, int>, std::pmr::string> Segments;
+
+  std::pmr::string cursor_position_format;
+  std::pmr::string clear_screen;
+  std::pmr::monotonic_buffer_resource frame_arenas[2];
+  // The frame being built and the one on screen, taking turns
+  Segments frames[2];
+  int current_frame{0};
+  bool invalidated{true};
+};
+
+#endif // !FRAME_COMPOSER_H
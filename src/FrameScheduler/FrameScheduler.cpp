@@ -0,0 +1,99 @@
+#include "FrameScheduler.h"
+
+FrameScheduler::FrameScheduler(int max_frames_per_second) {
+  set_max_frames_per_second(max_frames_per_second);
+}
+
+// Blocks until input arrives, one of the notification descriptors becomes
+// readable or a pending frame is due. Returns whether there is input to
+// process.
+bool FrameScheduler::wait_for_input(int input_fd,
+                                    const std::vector<int>& notification_fds) {
+  std::vector<struct pollfd> descriptors{{input_fd, POLLIN, 0}};
+
+  for (int notification_fd : notification_fds) {
+    descriptors.push_back({notification_fd, POLLIN, 0});
+  }
+
+  int timeout = frame_pending ? milliseconds_until_next_frame() : -1;
+  int num_ready = poll(descriptors.data(), descriptors.size(), timeout);
+
+  if (num_ready == -1 && errno != EINTR) {
+    throw std::runtime_error{"wait_for_input: could not poll for input"};
+  }
+
+  return num_ready > 0 && (descriptors[0].revents & POLLIN);
+}
+
+bool FrameScheduler::has_pending_input(int input_fd) const {
+  struct pollfd input{input_fd, POLLIN, 0};
+
+  return poll(&input, 1, 0) > 0 && (input.revents & POLLIN);
+}
+
+void FrameScheduler::input_processed() {
+  // The input is folded into a frame that was already going to be drawn
+  if (frame_pending) {
+    statistics.coalesced++;
+  }
+
+  frame_pending = true;
+}
+
+// For changes that did not come from input, e.g. background work finishing
+void FrameScheduler::request_frame() {
+  frame_pending = true;
+}
+
+bool FrameScheduler::is_frame_due() {
+  if (!frame_pending) {
+    return false;
+  }
+
+  if (milliseconds_until_next_frame() > 0) {
+    if (!frame_deferred) {
+      statistics.dropped++;
+      frame_deferred = true;
+    }
+
+    return false;
+  }
+
+  return true;
+}
+
+void FrameScheduler::frame_rendered() {
+  last_frame_time = Clock::now();
+  frame_pending = false;
+  frame_deferred = false;
+  statistics.rendered++;
+}
+
+// A limit of zero disables the cap
+void FrameScheduler::set_max_frames_per_second(int max_frames_per_second) {
+  this->max_frames_per_second =
+      max_frames_per_second > 0 ? max_frames_per_second : 0;
+  frame_interval = this->max_frames_per_second > 0
+                       ? Clock::duration{std::chrono::seconds{1}} /
+                             this->max_frames_per_second
+                       : Clock::duration{0};
+}
+
+const int& FrameScheduler::get_max_frames_per_second() const {
+  return max_frames_per_second;
+}
+
+const FrameStatistics& FrameScheduler::get_statistics() const {
+  return statistics;
+}
+
+int FrameScheduler::milliseconds_until_next_frame() const {
+  Clock::duration remaining = last_frame_time + frame_interval - Clock::now();
+
+  if (remaining <= Clock::duration{0}) {
+    return 0;
+  }
+
+  // Round up so that the wait never ends just before the slot opens
+  return std::chrono::ceil<std::chrono::milliseconds>(remaining).count();
+}
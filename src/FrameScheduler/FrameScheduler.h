@@ -0,0 +1,48 @@
+#ifndef FRAME_SCHEDULER_H
+#define FRAME_SCHEDULER_H
+
+#include <chrono>
+#include <vector>
+#include <poll.h>
+#include <errno.h>
+#include <stdexcept>
+
+typedef std::chrono::steady_clock Clock;
+
+struct FrameStatistics {
+  unsigned long rendered{0};
+  unsigned long coalesced{0};
+  unsigned long dropped{0};
+};
+
+// Decides when the screen gets redrawn. All pending input is handled before a
+// frame is drawn, and frames are drawn at most max_frames_per_second times a
+// second; a frame held back by that cap is drawn as soon as its slot arrives.
+class FrameScheduler {
+public:
+  FrameScheduler(int max_frames_per_second);
+
+  bool wait_for_input(int input_fd,
+                      const std::vector<int>& notification_fds = {});
+  bool has_pending_input(int input_fd) const;
+  void input_processed();
+  void request_frame();
+  bool is_frame_due();
+  void frame_rendered();
+
+  void set_max_frames_per_second(int max_frames_per_second);
+  const int& get_max_frames_per_second() const;
+  const FrameStatistics& get_statistics() const;
+
+private:
+  int max_frames_per_second{0};
+  Clock::duration frame_interval{0};
+  Clock::time_point last_frame_time{};
+  bool frame_pending{true};
+  bool frame_deferred{false};
+  FrameStatistics statistics;
+
+  int milliseconds_until_next_frame() const;
+};
+
+#endif // !FRAME_SCHEDULER_H
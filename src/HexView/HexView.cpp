@@ -0,0 +1,331 @@
+#include "HexView.h"
+
+static const char hex_digits[] = "0123456789abcdef";
+
+// Files with a NUL byte near their start are treated as binary, like most
+// tools that tell text from binary do
+bool is_binary_file(int file_descriptor) {
+  char start[HEX_VIEW_SNIFF_SIZE];
+  ssize_t num_bytes_read = pread(file_descriptor, start, sizeof(start), 0);
+
+  return num_bytes_read > 0 &&
+         memchr(start, '\0', num_bytes_read) != nullptr;
+}
+
+// Accepts hex digits, with or without spaces (`7f 45 4c 46`), or text in
+// double quotes (`"ELF"`)
+bool parse_byte_pattern(const std::string& text, std::string& pattern) {
+  pattern.clear();
+
+  if (text.length() >= 2 && text.front() == '"' && text.back() == '"') {
+    pattern = text.substr(1, text.length() - 2);
+    return !pattern.empty();
+  }
+
+  int pending_nibble = -1;
+
+  for (char character : text) {
+    if (character == ' ') {
+      continue;
+    }
+
+    const char* digit = strchr(hex_digits, tolower(character));
+
+    if (character == '\0' || digit == nullptr) {
+      return false;
+    }
+
+    int nibble = digit - hex_digits;
+
+    if (pending_nibble == -1) {
+      pending_nibble = nibble;
+    } else {
+      pattern.push_back((char)(pending_nibble << 4 | nibble));
+      pending_nibble = -1;
+    }
+  }
+
+  return pending_nibble == -1 && !pattern.empty();
+}
+
+// Writes the hex digits of 16 bytes, and their printable characters or dots.
+// With SSE2 all 16 bytes are converted at once: each nibble becomes '0' + n,
+// plus the distance to 'a' when it is above 9.
+static void format_full_row(const unsigned char* bytes, char* hex,
+                            char* ascii) {
+#ifdef __SSE2__
+  __m128i input = _mm_loadu_si128((const __m128i*)bytes);
+  __m128i nibble_mask = _mm_set1_epi8(0x0f);
+  __m128i high = _mm_and_si128(_mm_srli_epi16(input, 4), nibble_mask);
+  __m128i low = _mm_and_si128(input, nibble_mask);
+
+  auto to_digits = [](__m128i nibbles) {
+    __m128i is_letter = _mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9));
+    __m128i digits = _mm_add_epi8(nibbles, _mm_set1_epi8('0'));
+    return _mm_add_epi8(digits,
+                        _mm_and_si128(is_letter, _mm_set1_epi8('a' - '0' - 10)));
+  };
+
+  high = to_digits(high);
+  low = to_digits(low);
+  _mm_storeu_si128((__m128i*)hex, _mm_unpacklo_epi8(high, low));
+  _mm_storeu_si128((__m128i*)(hex + 16), _mm_unpackhi_epi8(high, low));
+
+  // Bytes from 0x80 up are negative as signed bytes, so they fail the first
+  // comparison along with the control characters
+  __m128i is_printable =
+      _mm_and_si128(_mm_cmpgt_epi8(input, _mm_set1_epi8(0x1f)),
+                    _mm_cmplt_epi8(input, _mm_set1_epi8(0x7f)));
+  __m128i characters =
+      _mm_or_si128(_mm_and_si128(is_printable, input),
+                   _mm_andnot_si128(is_printable, _mm_set1_epi8('.')));
+  _mm_storeu_si128((__m128i*)ascii, characters);
+#else
+  for (int i = 0; i < HEX_VIEW_BYTES_PER_ROW; i++) {
+    hex[2 * i] = hex_digits[bytes[i] >> 4];
+    hex[2 * i + 1] = hex_digits[bytes[i] & 0x0f];
+    ascii[i] = bytes[i] >= 0x20 && bytes[i] < 0x7f ? bytes[i] : '.';
+  }
+#endif
+}
+
+// Formats a row like `xxd` does: the offset, the bytes as groups of two, and
+// the bytes as text. Rows of fewer than 16 bytes are padded to line up.
+void format_hex_row(std::string& row, uint64_t offset, int offset_digits,
+                    const unsigned char* bytes, std::size_t count) {
+  char hex[2 * HEX_VIEW_BYTES_PER_ROW];
+  char ascii[HEX_VIEW_BYTES_PER_ROW];
+
+  if (count == HEX_VIEW_BYTES_PER_ROW) {
+    format_full_row(bytes, hex, ascii);
+  } else {
+    memset(hex, ' ', sizeof(hex));
+
+    for (std::size_t i = 0; i < count; i++) {
+      hex[2 * i] = hex_digits[bytes[i] >> 4];
+      hex[2 * i + 1] = hex_digits[bytes[i] & 0x0f];
+      ascii[i] = bytes[i] >= 0x20 && bytes[i] < 0x7f ? bytes[i] : '.';
+    }
+  }
+
+  row.resize(offset_digits + 2 + HEX_VIEW_BYTES_PER_ROW / 2 * 5 + 1 + count);
+  char* output = row.data();
+
+  for (int digit = offset_digits - 1; digit >= 0; digit--) {
+    output[digit] = hex_digits[offset & 0x0f];
+    offset >>= 4;
+  }
+
+  output += offset_digits;
+  *output++ = ':';
+  *output++ = ' ';
+
+  for (int group = 0; group < HEX_VIEW_BYTES_PER_ROW / 2; group++) {
+    memcpy(output, hex + 4 * group, 4);
+    output[4] = ' ';
+    output += 5;
+  }
+
+  *output++ = ' ';
+  memcpy(output, ascii, count);
+}
+
+// Keeps a descriptor of its own, so searches can go on reading after the
+// buffer closed its one
+HexView::HexView(int file_descriptor) {
+  struct stat file_stat;
+
+  if (fstat(file_descriptor, &file_stat) == -1) {
+    throw std::runtime_error{"HexView: could not stat file"};
+  }
+
+  size = file_stat.st_size;
+  this->file_descriptor = dup(file_descriptor);
+
+  if (this->file_descriptor == -1) {
+    throw std::runtime_error{"HexView: could not duplicate file descriptor"};
+  }
+
+  // Wide enough for the last offset, but never narrower than `xxd`
+  while (offset_digits < 16 && (size >> (4 * offset_digits)) > 0) {
+    offset_digits++;
+  }
+}
+
+HexView::~HexView() {
+  close(file_descriptor);
+}
+
+std::size_t HexView::get_size() const {
+  return size;
+}
+
+int64_t HexView::get_row_count() const {
+  return (size + HEX_VIEW_BYTES_PER_ROW - 1) / HEX_VIEW_BYTES_PER_ROW;
+}
+
+int HexView::get_row_length(int64_t row) const {
+  std::size_t offset = (std::size_t)row * HEX_VIEW_BYTES_PER_ROW;
+
+  return offset >= size ? 0
+                        : std::min<std::size_t>(HEX_VIEW_BYTES_PER_ROW,
+                                                size - offset);
+}
+
+// Where the hex digits of a byte start on screen
+int HexView::get_byte_column(int byte_index) const {
+  return offset_digits + 2 + byte_index / 2 * 5 + byte_index % 2 * 2;
+}
+
+void HexView::format_row(int64_t row, std::string& content) const {
+  std::size_t offset = (std::size_t)row * HEX_VIEW_BYTES_PER_ROW;
+  char bytes[HEX_VIEW_BYTES_PER_ROW];
+  std::size_t count = read_bytes(offset, bytes, get_row_length(row));
+
+  format_hex_row(content, offset, offset_digits, (const unsigned char*)bytes,
+                 count);
+}
+
+// Finds the next occurence of the pattern starting at or after `from`, or at
+// or before it when searching backwards, wrapping around the end of the file.
+// Returns std::string::npos when there is none or the token was cancelled.
+std::size_t HexView::find(
+    std::string_view pattern, std::size_t from, bool forward,
+    const CancellationToken& token,
+    const std::function<void(int percent)>& report_progress) const {
+  if (size == 0 || pattern.empty() || pattern.length() > size) {
+    return std::string::npos;
+  }
+
+  from %= size;
+
+  // Both halves of the wrapped search, in the order they are searched
+  std::size_t ranges[2][2] = {{from, size}, {0, from}};
+
+  if (!forward) {
+    ranges[0][0] = 0;
+    ranges[0][1] = from + 1;
+    ranges[1][0] = from + 1;
+    ranges[1][1] = size;
+  }
+
+  std::size_t searched = 0;
+  std::string data;
+
+  for (auto& range : ranges) {
+    std::size_t begin = range[0];
+    std::size_t end = range[1];
+
+    while (begin < end) {
+      if (token.is_cancelled()) {
+        return std::string::npos;
+      }
+
+      std::size_t chunk_size =
+          std::min<std::size_t>(end - begin, HEX_VIEW_SEARCH_CHUNK_SIZE);
+      std::size_t match =
+          forward ? find_forward(pattern, begin, begin + chunk_size, data)
+                  : find_backward(pattern, end - chunk_size, end, data);
+
+      if (match != std::string::npos) {
+        return match;
+      }
+
+      if (forward) {
+        begin += chunk_size;
+      } else {
+        end -= chunk_size;
+      }
+
+      searched += chunk_size;
+      report_progress(100 * searched / size);
+    }
+  }
+
+  return std::string::npos;
+}
+
+// Returns how many of the bytes could be read, which comes up short when the
+// file was truncated in the meantime
+std::size_t HexView::read_bytes(std::size_t offset, char* bytes,
+                                std::size_t count) const {
+  std::size_t length = 0;
+
+  while (length < count) {
+    ssize_t num_bytes_read =
+        pread(file_descriptor, bytes + length, count - length, offset + length);
+
+    if (num_bytes_read == -1 && errno == EINTR) {
+      continue;
+    }
+
+    if (num_bytes_read <= 0) {
+      break;
+    }
+
+    length += num_bytes_read;
+  }
+
+  return length;
+}
+
+// Reads [begin, end) of the file into data
+void HexView::read_range(std::size_t begin, std::size_t end,
+                         std::string& data) const {
+  data.resize(end - begin);
+  data.resize(read_bytes(begin, data.data(), data.length()));
+}
+
+// The first match starting in [begin, end)
+std::size_t HexView::find_forward(std::string_view pattern, std::size_t begin,
+                                  std::size_t end, std::string& data) const {
+  std::size_t search_end = std::min(end + pattern.length() - 1, size);
+
+  if (search_end - begin < pattern.length()) {
+    return std::string::npos;
+  }
+
+  read_range(begin, search_end, data);
+
+  const void* match =
+      memmem(data.data(), data.length(), pattern.data(), pattern.length());
+
+  return match == nullptr ? std::string::npos
+                          : begin + ((const char*)match - data.data());
+}
+
+// The last match starting in [begin, end)
+std::size_t HexView::find_backward(std::string_view pattern,
+                                   std::size_t begin, std::size_t end,
+                                   std::string& data) const {
+  end = std::min(end, size - pattern.length() + 1);
+
+  if (begin >= end) {
+    return std::string::npos;
+  }
+
+  read_range(begin, end + pattern.length() - 1, data);
+
+  // Only candidates the read reached completely
+  std::size_t candidate_end =
+      data.length() < pattern.length()
+          ? 0
+          : std::min(end - begin, data.length() - pattern.length() + 1);
+
+  while (candidate_end > 0) {
+    const char* candidate =
+        (const char*)memrchr(data.data(), pattern[0], candidate_end);
+
+    if (candidate == nullptr) {
+      break;
+    }
+
+    if (memcmp(candidate, pattern.data(), pattern.length()) == 0) {
+      return begin + (candidate - data.data());
+    }
+
+    candidate_end = candidate - data.data();
+  }
+
+  return std::string::npos;
+}
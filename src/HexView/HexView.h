@@ -0,0 +1,72 @@
+#ifndef HEX_VIEW_H
+#define HEX_VIEW_H
+
+#include <cstdint>
+#include <cstring>
+#include <cctype>
+#include <string>
+#include <string_view>
+#include <memory>
+#include <functional>
+#include <stdexcept>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "../LineStore/LineStore.h"
+#include "../TaskScheduler/TaskScheduler.h"
+
+#define HEX_VIEW_BYTES_PER_ROW 16
+// A file with a NUL byte this close to its start is opened in hex view
+#define HEX_VIEW_SNIFF_SIZE 4096
+// Searches check for cancellation and report progress once per chunk
+#define HEX_VIEW_SEARCH_CHUNK_SIZE ((std::size_t)16 << 20)
+
+bool is_binary_file(int file_descriptor);
+bool parse_byte_pattern(const std::string& text, std::string& pattern);
+void format_hex_row(std::string& row, uint64_t offset, int offset_digits,
+                    const unsigned char* bytes, std::size_t count);
+
+// A read-only view of a file as rows of offset, hex and ASCII columns, laid
+// out like `xxd`. Rows are read from the file when they are drawn, so only
+// what is on screen takes memory. Bytes past the end of a file that was
+// truncated since the view was opened are simply left out.
+class HexView {
+public:
+  HexView(int file_descriptor);
+  ~HexView();
+
+  HexView(const HexView&) = delete;
+  HexView& operator=(const HexView&) = delete;
+
+  std::size_t get_size() const;
+  int64_t get_row_count() const;
+  int get_row_length(int64_t row) const;
+  int get_byte_column(int byte_index) const;
+  void format_row(int64_t row, std::string& content) const;
+
+  std::size_t find(std::string_view pattern, std::size_t from, bool forward,
+                   const CancellationToken& token,
+                   const std::function<void(int percent)>& report_progress)
+      const;
+
+private:
+  int file_descriptor{-1};
+  std::size_t size{0};
+  int offset_digits{8};
+
+  std::size_t read_bytes(std::size_t offset, char* bytes,
+                         std::size_t count) const;
+  void read_range(std::size_t begin, std::size_t end, std::string& data) const;
+  std::size_t find_forward(std::string_view pattern, std::size_t begin,
+                           std::size_t end, std::string& data) const;
+  std::size_t find_backward(std::string_view pattern, std::size_t begin,
+                            std::size_t end, std::string& data) const;
+};
+
+#endif // !HEX_VIEW_H
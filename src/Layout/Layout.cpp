@@ -0,0 +1,137 @@
+#include "Layout.h"
+
+// Smallest viewport a split may leave behind, status bar excluded
+#define LAYOUT_MIN_HEIGHT 1
+#define LAYOUT_MIN_WIDTH 10
+
+Layout::Layout(Buffer* buffer) : root(std::make_unique<Node>()) {
+  root->viewport = std::make_unique<Viewport>();
+  root->viewport->buffer = buffer;
+}
+
+// Splits a viewport in two, the new half shows the same buffer at the same
+// position. Returns nullptr when the viewport is too small to split.
+Viewport* Layout::split(Viewport* viewport, bool side_by_side) {
+  Node* node = find(root.get(), viewport);
+
+  if (node == nullptr) {
+    return nullptr;
+  }
+
+  bool fits = side_by_side
+                  ? viewport->width >= 2 * LAYOUT_MIN_WIDTH + 1
+                  : viewport->height + 1 >= 2 * (LAYOUT_MIN_HEIGHT + 1);
+
+  if (!fits) {
+    return nullptr;
+  }
+
+  node->first = std::make_unique<Node>();
+  node->first->viewport = std::move(node->viewport);
+  node->first->parent = node;
+
+  node->second = std::make_unique<Node>();
+  node->second->viewport = std::make_unique<Viewport>(*viewport);
+  node->second->parent = node;
+
+  node->side_by_side = side_by_side;
+
+  return node->second->viewport.get();
+}
+
+// Closes a viewport and gives its space to its sibling. Returns the viewport
+// that should take focus, or nullptr if it was the last one.
+Viewport* Layout::close(Viewport* viewport) {
+  Node* node = find(root.get(), viewport);
+
+  if (node == nullptr || node == root.get()) {
+    return nullptr;
+  }
+
+  Node* parent = node->parent;
+  std::unique_ptr<Node> sibling = std::move(
+      parent->first.get() == node ? parent->second : parent->first);
+
+  parent->first = nullptr;
+  parent->second = nullptr;
+
+  parent->viewport = std::move(sibling->viewport);
+  parent->side_by_side = sibling->side_by_side;
+  parent->first = std::move(sibling->first);
+  parent->second = std::move(sibling->second);
+
+  if (parent->first != nullptr) {
+    parent->first->parent = parent;
+    parent->second->parent = parent;
+  }
+
+  std::vector<Viewport*> remaining;
+  collect(parent, remaining);
+
+  return remaining.front();
+}
+
+// Lays the viewports out over a screen area of the given size
+void Layout::arrange(int width, int height) {
+  separators.clear();
+  arrange(root.get(), 0, 0, width, height);
+}
+
+std::vector<Viewport*> Layout::get_viewports() const {
+  std::vector<Viewport*> viewports;
+  collect(root.get(), viewports);
+  return viewports;
+}
+
+// Screen cells of the columns drawn between side by side viewports
+const std::vector<CursorPosition>& Layout::get_separators() const {
+  return separators;
+}
+
+Layout::Node* Layout::find(Node* node, const Viewport* viewport) const {
+  if (node->viewport != nullptr) {
+    return node->viewport.get() == viewport ? node : nullptr;
+  }
+
+  Node* found = find(node->first.get(), viewport);
+
+  return found != nullptr ? found : find(node->second.get(), viewport);
+}
+
+void Layout::arrange(Node* node, int top, int left, int width, int height) {
+  if (node->viewport != nullptr) {
+    node->viewport->top = top;
+    node->viewport->left = left;
+    node->viewport->width = width;
+    node->viewport->height = height - 1;
+    return;
+  }
+
+  if (node->side_by_side) {
+    int first_width = (width - 1) / 2;
+
+    for (int row = top; row < top + height; row++) {
+      separators.push_back(CursorPosition{left + first_width, row});
+    }
+
+    arrange(node->first.get(), top, left, first_width, height);
+    arrange(node->second.get(), top, left + first_width + 1,
+            width - first_width - 1, height);
+  } else {
+    int first_height = height / 2;
+
+    arrange(node->first.get(), top, left, width, first_height);
+    arrange(node->second.get(), top + first_height, left, width,
+            height - first_height);
+  }
+}
+
+void Layout::collect(Node* node, std::vector<Viewport*>& viewports) const {
+  if (node->viewport != nullptr) {
+    viewports.push_back(node->viewport.get());
+    return;
+  }
+
+  collect(node->first.get(), viewports);
+  collect(node->second.get(), viewports);
+}
@@ -0,0 +1,53 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <memory>
+#include <vector>
+
+#include "../Buffer/Buffer.h"
+
+// A pane showing a buffer. Its text area starts at (top, left) on screen and
+// is followed by a status bar on the row below it.
+struct Viewport {
+  Buffer* buffer{nullptr};
+  int top{0};
+  int left{0};
+  int width{0};
+  int height{0};
+  CursorPosition cursor_position{0, 0};
+  int64_t vertical_scroll_offset{0};
+  int horizontal_scroll_offset{0};
+};
+
+// Splits the screen into viewports. Every split divides one viewport in two,
+// either stacked or side by side, so the layout forms a binary tree whose
+// leaves are the viewports.
+class Layout {
+public:
+  Layout(Buffer* buffer);
+
+  Viewport* split(Viewport* viewport, bool side_by_side);
+  Viewport* close(Viewport* viewport);
+  void arrange(int width, int height);
+
+  std::vector<Viewport*> get_viewports() const;
+  const std::vector<CursorPosition>& get_separators() const;
+
+private:
+  struct Node {
+    std::unique_ptr<Viewport> viewport;
+    bool side_by_side{false};
+    std::unique_ptr<Node> first;
+    std::unique_ptr<Node> second;
+    Node* parent{nullptr};
+  };
+
+  std::unique_ptr<Node> root;
+  std::vector<CursorPosition> separators;
+
+  Node* find(Node* node, const Viewport* viewport) const;
+  void arrange(Node* node, int top, int left, int width, int height);
+  void collect(Node* node, std::vector<Viewport*>& viewports) const;
+};
+
+#endif // !LAYOUT_H
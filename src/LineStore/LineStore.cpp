@@ -0,0 +1,437 @@
+#include "LineStore.h"
+
+struct NewlineChunk {
+  std::size_t newline_count{0};
+  std::size_t last_newline{0};
+};
+
+FileContents::FileContents(std::size_t size,
+                           std::pmr::memory_resource* resource)
+    : resource(resource), length(size) {
+  if (length > 0) {
+    address = (char*)resource->allocate(length, 1);
+  }
+}
+
+FileContents::~FileContents() {
+  if (address != nullptr) {
+    resource->deallocate(address, length, 1);
+  }
+}
+
+// Fills the contents from the start of the file, in parallel chunks. A file
+// that got shorter since its size was taken cannot fill them.
+void FileContents::read(int file_descriptor) {
+  std::atomic<bool> is_complete{true};
+
+  parallel_for(length, [&](std::size_t begin, std::size_t end, std::size_t) {
+    while (begin < end) {
+      ssize_t num_bytes_read =
+          pread(file_descriptor, address + begin, end - begin, begin);
+
+      if (num_bytes_read == -1 && errno == EINTR) {
+        continue;
+      }
+
+      if (num_bytes_read <= 0) {
+        is_complete = false;
+        return;
+      }
+
+      begin += num_bytes_read;
+    }
+  });
+
+  if (!is_complete) {
+    throw std::runtime_error{"read: could not read file"};
+  }
+}
+
+char* FileContents::data() {
+  return address;
+}
+
+const char* FileContents::data() const {
+  return address;
+}
+
+std::size_t FileContents::size() const {
+  return length;
+}
+
+LineSnapshot::LineSnapshot(std::pmr::memory_resource* resource)
+    : entries(resource), side_slots(resource) {}
+
+std::size_t LineSnapshot::size() const {
+  return entries.size();
+}
+
+std::string_view LineSnapshot::operator[](std::size_t line_number) const {
+  const LineEntry& entry = entries[line_number];
+
+  if (entry.in_side_slot) {
+    return side_slots[entry.offset];
+  }
+
+  return std::string_view{file_contents->data() + entry.offset, entry.length};
+}
+
+bool LineSnapshot::is_modified(std::size_t line_number) const {
+  return entries[line_number].in_side_slot;
+}
+
+off_t LineSnapshot::get_offset(std::size_t line_number) const {
+  return entries[line_number].offset;
+}
+
+LineStore::LineStore(std::pmr::memory_resource* resource,
+                     std::pmr::memory_resource* file_resource)
+    : resource(resource), file_resource(file_resource), entries(resource),
+      side_slots(resource), free_side_slots(resource) {}
+
+LineStore::~LineStore() {
+  release_file();
+}
+
+// Replaces the contents with the lines of the given file
+void LineStore::read(int file_descriptor) {
+  struct stat file_stat;
+
+  if (fstat(file_descriptor, &file_stat) == -1) {
+    throw std::runtime_error{"read: could not stat file"};
+  }
+
+  clear();
+  read_file(file_descriptor, file_stat.st_size);
+
+  // Find the line boundaries in parallel: count the newlines of every chunk
+  // first, which tells each chunk where its lines go in the table
+  std::vector<NewlineChunk> chunks(parallel_chunk_count(contents_size));
+
+  parallel_for(contents_size, [&](std::size_t begin, std::size_t end,
+                                  std::size_t chunk) {
+    const char* position = contents + begin;
+    const char* chunk_end = contents + end;
+
+    while ((position = (const char*)memchr(position, '\n',
+                                           chunk_end - position)) != nullptr) {
+      chunks[chunk].newline_count++;
+      chunks[chunk].last_newline = position - contents;
+      position++;
+    }
+  });
+
+  std::vector<std::size_t> first_lines(chunks.size());
+  std::vector<std::size_t> line_starts(chunks.size());
+  std::size_t line_count = 0;
+  std::size_t line_start = 0;
+
+  for (std::size_t chunk = 0; chunk < chunks.size(); chunk++) {
+    first_lines[chunk] = line_count;
+    line_starts[chunk] = line_start;
+    line_count += chunks[chunk].newline_count;
+
+    if (chunks[chunk].newline_count > 0) {
+      line_start = chunks[chunk].last_newline + 1;
+    }
+  }
+
+  bool has_unterminated_line = line_start < contents_size;
+  entries.resize(line_count + (has_unterminated_line ? 1 : 0));
+
+  parallel_for(contents_size, [&](std::size_t begin, std::size_t end,
+                                  std::size_t chunk) {
+    const char* position = contents + begin;
+    const char* chunk_end = contents + end;
+    std::size_t line_number = first_lines[chunk];
+    std::size_t line_start = line_starts[chunk];
+
+    while ((position = (const char*)memchr(position, '\n',
+                                           chunk_end - position)) != nullptr) {
+      std::size_t length = (position - contents) - line_start;
+      entries[line_number++] = LineEntry{
+          line_start, std::min<std::size_t>(length, LINE_STORE_MAX_LENGTH), 0};
+      line_start = position - contents + 1;
+      position++;
+    }
+  });
+
+  if (has_unterminated_line) {
+    entries.back() = LineEntry{
+        line_start,
+        std::min<std::size_t>(contents_size - line_start, LINE_STORE_MAX_LENGTH),
+        0};
+  }
+
+  // Lines too long to be referenced in place are copied into side slots
+  for (std::size_t line_number = 0; line_number < entries.size();
+       line_number++) {
+    if (entries[line_number].length < LINE_STORE_MAX_LENGTH) {
+      continue;
+    }
+
+    std::size_t start = entries[line_number].offset;
+    std::size_t end = line_number + 1 < entries.size()
+                          ? entries[line_number + 1].offset - 1
+                          : (has_unterminated_line ? contents_size
+                                                   : contents_size - 1);
+
+    uint64_t slot =
+        allocate_side_slot(std::string_view{contents + start, end - start});
+    entries[line_number] = LineEntry{slot, 0, 1};
+  }
+}
+
+// Called once the lines were written to the given file, each followed by a
+// newline. Every line becomes a span of new contents built from the lines in
+// memory, which drops the side slots without reading the file back. Returns
+// false, leaving the store as it was, when the file does not have the size
+// the lines add up to, e.g. because another program changed it meanwhile.
+bool LineStore::rebase(int file_descriptor) {
+  std::size_t size = 0;
+
+  for (std::size_t line_number = 0; line_number < entries.size();
+       line_number++) {
+    size += (*this)[line_number].length() + 1;
+  }
+
+  struct stat file_stat;
+
+  if (fstat(file_descriptor, &file_stat) == -1 ||
+      (std::size_t)file_stat.st_size != size) {
+    return false;
+  }
+
+  std::shared_ptr<FileContents> rebased_contents = allocate_file(size);
+  std::pmr::vector<LineEntry> rebased_entries(entries.size(), resource);
+  char* output = rebased_contents->data();
+  std::size_t offset = 0;
+
+  for (std::size_t line_number = 0; line_number < entries.size();
+       line_number++) {
+    LineEntry entry = entries[line_number];
+    std::string_view line = (*this)[line_number];
+
+    memcpy(output + offset, line.data(), line.length());
+    output[offset + line.length()] = '\n';
+
+    if (line.length() < LINE_STORE_MAX_LENGTH) {
+      rebased_entries[line_number] = LineEntry{offset, line.length(), 0};
+
+      if (entry.in_side_slot) {
+        release_side_slot(entry.offset);
+      }
+    } else {
+      rebased_entries[line_number] = entry;
+    }
+
+    offset += line.length() + 1;
+  }
+
+  entries = std::move(rebased_entries);
+  set_file(rebased_contents);
+
+  if (side_slots.size() == free_side_slots.size()) {
+    side_slots.clear();
+    side_slots.shrink_to_fit();
+    free_side_slots.clear();
+    free_side_slots.shrink_to_fit();
+  }
+
+  return true;
+}
+
+void LineStore::clear() {
+  entries.clear();
+  entries.shrink_to_fit();
+  side_slots.clear();
+  side_slots.shrink_to_fit();
+  free_side_slots.clear();
+  free_side_slots.shrink_to_fit();
+  release_file();
+  change_count++;
+}
+
+// Both stores must allocate from the same resource
+void LineStore::swap(LineStore& other) {
+  std::swap(file_contents, other.file_contents);
+  std::swap(contents, other.contents);
+  std::swap(contents_size, other.contents_size);
+  entries.swap(other.entries);
+  side_slots.swap(other.side_slots);
+  free_side_slots.swap(other.free_side_slots);
+  change_count++;
+  other.change_count++;
+}
+
+LineSnapshot LineStore::snapshot(
+    std::pmr::memory_resource* snapshot_resource) const {
+  LineSnapshot snapshot{snapshot_resource};
+
+  snapshot.file_contents = file_contents;
+  snapshot.entries.assign(entries.begin(), entries.end());
+  snapshot.side_slots.reserve(side_slots.size());
+
+  for (const std::pmr::string& slot : side_slots) {
+    snapshot.side_slots.emplace_back(slot);
+  }
+
+  return snapshot;
+}
+
+std::size_t LineStore::size() const {
+  return entries.size();
+}
+
+bool LineStore::empty() const {
+  return entries.empty();
+}
+
+std::string_view LineStore::operator[](std::size_t line_number) const {
+  const LineEntry& entry = entries[line_number];
+
+  if (entry.in_side_slot) {
+    return side_slots[entry.offset];
+  }
+
+  return std::string_view{contents + entry.offset, entry.length};
+}
+
+bool LineStore::is_modified(std::size_t line_number) const {
+  return entries[line_number].in_side_slot;
+}
+
+// Where an unmodified line starts in the file
+off_t LineStore::get_offset(std::size_t line_number) const {
+  return entries[line_number].offset;
+}
+
+uint64_t LineStore::get_change_count() const {
+  return change_count;
+}
+
+// Gives mutable access to a line, moving it to a side slot if needed. The
+// reference stays valid until the line is erased, and counts as a change.
+std::pmr::string& LineStore::edit(std::size_t line_number) {
+  LineEntry& entry = entries[line_number];
+
+  change_count++;
+
+  if (!entry.in_side_slot) {
+    entry = LineEntry{allocate_side_slot((*this)[line_number]), 0, 1};
+  }
+
+  return side_slots[entry.offset];
+}
+
+void LineStore::set(std::size_t line_number, std::string_view text) {
+  edit(line_number).assign(text);
+}
+
+void LineStore::insert(std::size_t line_number, std::string_view text) {
+  entries.insert(entries.begin() + line_number,
+                 LineEntry{allocate_side_slot(text), 0, 1});
+  change_count++;
+}
+
+void LineStore::erase(std::size_t line_number) {
+  if (entries[line_number].in_side_slot) {
+    release_side_slot(entries[line_number].offset);
+  }
+
+  entries.erase(entries.begin() + line_number);
+  change_count++;
+}
+
+// Moves the lines listed in `order` into [begin, end) and drops the others.
+// Only table entries move, the text of the lines stays where it is.
+void LineStore::reorder(std::size_t begin, std::size_t end,
+                        const std::vector<std::size_t>& order) {
+  std::vector<bool> is_kept(end - begin, false);
+  std::pmr::vector<LineEntry> ordered_entries(order.size(), resource);
+
+  for (std::size_t i = 0; i < order.size(); i++) {
+    ordered_entries[i] = entries[order[i]];
+    is_kept[order[i] - begin] = true;
+  }
+
+  for (std::size_t line_number = begin; line_number < end; line_number++) {
+    if (!is_kept[line_number - begin] && entries[line_number].in_side_slot) {
+      release_side_slot(entries[line_number].offset);
+    }
+  }
+
+  entries.erase(entries.begin() + begin, entries.begin() + end);
+  entries.insert(entries.begin() + begin, ordered_entries.begin(),
+                 ordered_entries.end());
+  change_count++;
+}
+
+LineStoreStatistics LineStore::get_statistics() const {
+  LineStoreStatistics statistics;
+
+  statistics.line_count = entries.size();
+  statistics.file_bytes = contents_size;
+  statistics.table_bytes = entries.capacity() * sizeof(LineEntry) +
+                           free_side_slots.capacity() * sizeof(uint64_t);
+  statistics.side_slot_count = side_slots.size() - free_side_slots.size();
+  statistics.side_slot_bytes = side_slots.size() * sizeof(std::pmr::string);
+
+  for (const std::pmr::string& slot : side_slots) {
+    // Short strings live inside the slot itself
+    if (slot.capacity() > 15) {
+      statistics.side_slot_bytes += slot.capacity() + 1;
+    }
+  }
+
+  return statistics;
+}
+
+std::shared_ptr<FileContents> LineStore::allocate_file(
+    std::size_t size) const {
+  return std::allocate_shared<FileContents>(
+      std::pmr::polymorphic_allocator<FileContents>{file_resource}, size,
+      file_resource);
+}
+
+// Reads the first `size` bytes of the file into contents of their own, which
+// replace the current ones only once they were read completely
+void LineStore::read_file(int file_descriptor, std::size_t size) {
+  if (size == 0) {
+    release_file();
+    return;
+  }
+
+  std::shared_ptr<FileContents> new_contents = allocate_file(size);
+  new_contents->read(file_descriptor);
+  set_file(new_contents);
+}
+
+void LineStore::set_file(std::shared_ptr<const FileContents> new_contents) {
+  file_contents = std::move(new_contents);
+  contents = file_contents != nullptr ? file_contents->data() : nullptr;
+  contents_size = file_contents != nullptr ? file_contents->size() : 0;
+}
+
+// The contents themselves go away with their last snapshot
+void LineStore::release_file() {
+  set_file(nullptr);
+}
+
+uint64_t LineStore::allocate_side_slot(std::string_view text) {
+  if (!free_side_slots.empty()) {
+    uint64_t slot = free_side_slots.back();
+    free_side_slots.pop_back();
+    side_slots[slot].assign(text);
+    return slot;
+  }
+
+  side_slots.emplace_back(text);
+  return side_slots.size() - 1;
+}
+
+void LineStore::release_side_slot(uint64_t slot) {
+  side_slots[slot].clear();
+  side_slots[slot].shrink_to_fit();
+  free_side_slots.push_back(slot);
+}
@@ -0,0 +1,138 @@
+#ifndef LINE_STORE_H
+#define LINE_STORE_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <memory_resource>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <atomic>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "../Parallel/Parallel.h"
+
+// Longest line that can be referenced in place, longer ones live in a slot
+#define LINE_STORE_MAX_LENGTH ((1 << 23) - 1)
+
+// A line is either a span of the file's contents or, once edited, a side slot
+struct LineEntry {
+  uint64_t offset : 40;
+  uint64_t length : 23;
+  uint64_t in_side_slot : 1;
+};
+
+struct LineStoreStatistics {
+  std::size_t line_count{0};
+  std::size_t file_bytes{0};
+  std::size_t table_bytes{0};
+  std::size_t side_slot_count{0};
+  std::size_t side_slot_bytes{0};
+};
+
+// A copy of a file's contents, read once and never written to again, so other
+// programs changing the file cannot change or invalidate it. Shared by a store
+// and its snapshots, so a snapshot stays readable after the store moved on to
+// another file.
+class FileContents {
+public:
+  FileContents(std::size_t size, std::pmr::memory_resource* resource);
+  ~FileContents();
+
+  FileContents(const FileContents&) = delete;
+  FileContents& operator=(const FileContents&) = delete;
+
+  void read(int file_descriptor);
+  char* data();
+  const char* data() const;
+  std::size_t size() const;
+
+private:
+  std::pmr::memory_resource* resource;
+  char* address{nullptr};
+  std::size_t length{0};
+};
+
+// A copy of a store's lines as they were when it was taken, which can be read
+// on another thread while the store keeps changing. Only the table and the
+// edited lines are copied, into the resource the snapshot was taken with; the
+// rest is read from the shared file contents.
+class LineSnapshot {
+public:
+  LineSnapshot(std::pmr::memory_resource* resource);
+
+  std::size_t size() const;
+  std::string_view operator[](std::size_t line_number) const;
+  bool is_modified(std::size_t line_number) const;
+  off_t get_offset(std::size_t line_number) const;
+
+private:
+  friend class LineStore;
+
+  std::shared_ptr<const FileContents> file_contents;
+  std::pmr::vector<LineEntry> entries;
+  std::pmr::vector<std::pmr::string> side_slots;
+};
+
+// Stores a buffer's lines compactly. The file is read into one block from
+// file_resource, and unmodified lines cost a single 8 byte table entry each
+// pointing into it; a line moves to a side slot the first time it is edited.
+// The block may outlive the store in a snapshot, so file_resource has to
+// outlive every snapshot as well.
+class LineStore {
+public:
+  LineStore(std::pmr::memory_resource* resource,
+            std::pmr::memory_resource* file_resource);
+  ~LineStore();
+
+  LineStore(const LineStore&) = delete;
+  LineStore& operator=(const LineStore&) = delete;
+
+  void read(int file_descriptor);
+  bool rebase(int file_descriptor);
+  void clear();
+  void swap(LineStore& other);
+  LineSnapshot snapshot(std::pmr::memory_resource* snapshot_resource) const;
+
+  std::size_t size() const;
+  bool empty() const;
+  std::string_view operator[](std::size_t line_number) const;
+  bool is_modified(std::size_t line_number) const;
+  off_t get_offset(std::size_t line_number) const;
+  uint64_t get_change_count() const;
+
+  std::pmr::string& edit(std::size_t line_number);
+  void set(std::size_t line_number, std::string_view text);
+  void insert(std::size_t line_number, std::string_view text);
+  void erase(std::size_t line_number);
+  void reorder(std::size_t begin, std::size_t end,
+               const std::vector<std::size_t>& order);
+
+  LineStoreStatistics get_statistics() const;
+
+private:
+  std::pmr::memory_resource* resource;
+  std::pmr::memory_resource* file_resource;
+  std::shared_ptr<const FileContents> file_contents;
+  const char* contents{nullptr};
+  std::size_t contents_size{0};
+  std::pmr::vector<LineEntry> entries;
+  std::pmr::deque<std::pmr::string> side_slots;
+  std::pmr::vector<uint64_t> free_side_slots;
+  uint64_t change_count{0};
+
+  std::shared_ptr<FileContents> allocate_file(std::size_t size) const;
+  void read_file(int file_descriptor, std::size_t size);
+  void set_file(std::shared_ptr<const FileContents> new_contents);
+  void release_file();
+  uint64_t allocate_side_slot(std::string_view text);
+  void release_side_slot(uint64_t slot);
+};
+
+#endif // !LINE_STORE_H
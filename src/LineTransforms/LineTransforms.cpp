@@ -0,0 +1,174 @@
+#include "LineTransforms.h"
+
+// Mirrors `sort -n`: leading blanks are skipped and a line that does not start
+// with a number sorts as zero
+static double numeric_key(std::string_view line) {
+  std::size_t start = line.find_first_not_of(" \t");
+
+  if (start == std::string::npos) {
+    return 0;
+  }
+
+  const char* first = line.data() + start;
+  const char* last = line.data() + line.length();
+
+  if (*first == '+') {
+    first++;
+  }
+
+  double key = 0;
+  std::from_chars_result result = std::from_chars(first, last, key);
+
+  if (result.ec != std::errc{} || std::isnan(key)) {
+    return 0;
+  }
+
+  return key;
+}
+
+LineOrder sort_lines(const LineStore& lines, std::size_t begin,
+                     std::size_t end, bool numeric,
+                     const ProgressCallback& report_progress) {
+  std::size_t count = end - begin;
+  LineOrder order(count);
+  std::iota(order.begin(), order.end(), begin);
+
+  std::vector<double> keys;
+
+  if (numeric) {
+    keys.resize(count);
+    parallel_for(count, [&](std::size_t first, std::size_t last, std::size_t) {
+      for (std::size_t i = first; i < last; i++) {
+        keys[i] = numeric_key(lines[begin + i]);
+      }
+    });
+  }
+
+  auto is_less = [&](std::size_t a, std::size_t b) {
+    if (numeric) {
+      return keys[a - begin] < keys[b - begin];
+    }
+
+    return lines[a] < lines[b];
+  };
+
+  // Sort one run per chunk concurrently, then merge neighbouring runs pairwise
+  // until a single run is left. Both steps are stable.
+  std::size_t run_count = parallel_chunk_count(count);
+  std::vector<std::size_t> run_bounds(run_count + 1, count);
+
+  parallel_for(count, [&](std::size_t first, std::size_t last,
+                          std::size_t chunk) {
+    run_bounds[chunk] = first;
+    std::stable_sort(order.begin() + first, order.begin() + last, is_less);
+  });
+
+  int pass_count = 1;
+  while ((std::size_t)1 << (pass_count - 1) < run_count) {
+    pass_count++;
+  }
+
+  int pass = 1;
+  report_progress(100 * pass / pass_count);
+
+  while (run_bounds.size() > 2) {
+    std::size_t pair_count = (run_bounds.size() - 1) / 2;
+
+    parallel_for(
+        pair_count,
+        [&](std::size_t first, std::size_t last, std::size_t) {
+          for (std::size_t pair = first; pair < last; pair++) {
+            std::inplace_merge(order.begin() + run_bounds[2 * pair],
+                               order.begin() + run_bounds[2 * pair + 1],
+                               order.begin() + run_bounds[2 * pair + 2],
+                               is_less);
+          }
+        },
+        1);
+
+    std::vector<std::size_t> merged_bounds;
+
+    for (std::size_t i = 0; i < run_bounds.size(); i += 2) {
+      merged_bounds.push_back(run_bounds[i]);
+    }
+
+    if ((run_bounds.size() - 1) % 2 == 1) {
+      merged_bounds.push_back(run_bounds.back());
+    }
+
+    run_bounds = std::move(merged_bounds);
+
+    pass++;
+    report_progress(100 * pass / pass_count);
+  }
+
+  return order;
+}
+
+LineOrder unique_lines(const LineStore& lines,
+                       std::size_t begin, std::size_t end) {
+  std::size_t count = end - begin;
+  std::vector<std::size_t> hashes(count);
+
+  parallel_for(count, [&](std::size_t first, std::size_t last, std::size_t) {
+    for (std::size_t i = first; i < last; i++) {
+      hashes[i] = std::hash<std::string_view>{}(lines[begin + i]);
+    }
+  });
+
+  auto hash_of = [&](std::size_t line_number) {
+    return hashes[line_number - begin];
+  };
+  auto is_equal = [&](std::size_t a, std::size_t b) {
+    return lines[a] == lines[b];
+  };
+
+  // Keeps the first occurence of every line, wherever its duplicates are
+  std::unordered_set<std::size_t, decltype(hash_of), decltype(is_equal)> seen(
+      count, hash_of, is_equal);
+  LineOrder order;
+
+  for (std::size_t line_number = begin; line_number < end; line_number++) {
+    if (seen.insert(line_number).second) {
+      order.push_back(line_number);
+    }
+  }
+
+  return order;
+}
+
+LineOrder filter_lines(const LineStore& lines,
+                       std::size_t begin, std::size_t end,
+                       const std::string& pattern, bool keep_matches) {
+  std::size_t count = end - begin;
+  std::vector<LineOrder> chunk_orders(parallel_chunk_count(count));
+
+  parallel_for(count, [&](std::size_t first, std::size_t last,
+                          std::size_t chunk) {
+    for (std::size_t i = first; i < last; i++) {
+      bool is_match = lines[begin + i].find(pattern) != std::string::npos;
+
+      if (is_match == keep_matches) {
+        chunk_orders[chunk].push_back(begin + i);
+      }
+    }
+  });
+
+  LineOrder order;
+
+  for (const LineOrder& chunk_order : chunk_orders) {
+    order.insert(order.end(), chunk_order.begin(), chunk_order.end());
+  }
+
+  return order;
+}
+
+LineOrder reverse_lines(std::size_t begin, std::size_t end) {
+  LineOrder order(end - begin);
+
+  for (std::size_t i = 0; i < order.size(); i++) {
+    order[i] = end - 1 - i;
+  }
+
+  return order;
+}
@@ -0,0 +1,33 @@
+#ifndef LINE_TRANSFORMS_H
+#define LINE_TRANSFORMS_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <numeric>
+#include <charconv>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+#include <unordered_set>
+
+#include "../Parallel/Parallel.h"
+#include "../LineStore/LineStore.h"
+
+// Transforms never touch line contents. Each one returns the indices of the
+// lines in [begin, end) that should make up the range afterwards, in their new
+// order, and it is up to the caller to move the lines into place.
+typedef std::vector<std::size_t> LineOrder;
+typedef std::function<void(int percent)> ProgressCallback;
+
+LineOrder sort_lines(const LineStore& lines, std::size_t begin,
+                     std::size_t end, bool numeric,
+                     const ProgressCallback& report_progress);
+LineOrder unique_lines(const LineStore& lines,
+                       std::size_t begin, std::size_t end);
+LineOrder filter_lines(const LineStore& lines,
+                       std::size_t begin, std::size_t end,
+                       const std::string& pattern, bool keep_matches);
+LineOrder reverse_lines(std::size_t begin, std::size_t end);
+
+#endif // !LINE_TRANSFORMS_H
@@ -0,0 +1,87 @@
+#include "MemoryAccount.h"
+
+// Formats a quantity in at most four characters, e.g. 512, 12K or 1.5M
+static std::string format_quantity(std::size_t quantity) {
+  const char units[] = {'\0', 'K', 'M', 'G', 'T'};
+  double value = quantity;
+  std::size_t unit = 0;
+
+  while (value >= 1000 && unit + 1 < sizeof(units)) {
+    value /= 1024;
+    unit++;
+  }
+
+  char formatted[16];
+
+  if (unit == 0) {
+    snprintf(formatted, sizeof(formatted), "%zu", quantity);
+  } else if (value < 10) {
+    snprintf(formatted, sizeof(formatted), "%.1f%c", value, units[unit]);
+  } else {
+    snprintf(formatted, sizeof(formatted), "%.0f%c", value, units[unit]);
+  }
+
+  return formatted;
+}
+
+MemoryAccount::MemoryAccount(const std::string& name) : name(name) {}
+
+void MemoryAccount::record_allocation(std::size_t bytes) {
+  std::size_t live = live_bytes.fetch_add(bytes, std::memory_order_relaxed) +
+                     bytes;
+  std::size_t peak = peak_bytes.load(std::memory_order_relaxed);
+
+  while (live > peak && !peak_bytes.compare_exchange_weak(
+                            peak, live, std::memory_order_relaxed)) {
+  }
+
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void MemoryAccount::record_deallocation(std::size_t bytes) {
+  live_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+// Live/peak bytes and the number of allocations, e.g. "render 95K/130K #4.1K"
+std::string MemoryAccount::describe() const {
+  return name + " " + format_quantity(get_live_bytes()) + "/" +
+         format_quantity(get_peak_bytes()) + " #" +
+         format_quantity(get_allocation_count());
+}
+
+const std::string& MemoryAccount::get_name() const {
+  return name;
+}
+
+std::size_t MemoryAccount::get_live_bytes() const {
+  return live_bytes.load(std::memory_order_relaxed);
+}
+
+std::size_t MemoryAccount::get_peak_bytes() const {
+  return peak_bytes.load(std::memory_order_relaxed);
+}
+
+std::size_t MemoryAccount::get_allocation_count() const {
+  return allocation_count.load(std::memory_order_relaxed);
+}
+
+TrackingResource::TrackingResource(MemoryAccount* account,
+                                   std::pmr::memory_resource* upstream)
+    : account(account), upstream(upstream) {}
+
+void* TrackingResource::do_allocate(std::size_t bytes, std::size_t alignment) {
+  void* block = upstream->allocate(bytes, alignment);
+  account->record_allocation(bytes);
+  return block;
+}
+
+void TrackingResource::do_deallocate(void* block, std::size_t bytes,
+                                     std::size_t alignment) {
+  upstream->deallocate(block, bytes, alignment);
+  account->record_deallocation(bytes);
+}
+
+bool TrackingResource::do_is_equal(
+    const std::pmr::memory_resource& other) const noexcept {
+  return this == &other;
+}
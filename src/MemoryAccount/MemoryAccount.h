@@ -0,0 +1,52 @@
+#ifndef MEMORY_ACCOUNT_H
+#define MEMORY_ACCOUNT_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <memory_resource>
+
+// What one part of the editor allocated: bytes currently allocated and the
+// most that ever were, and how many allocations were made in total. Updated
+// from any thread.
+class MemoryAccount {
+public:
+  MemoryAccount(const std::string& name);
+
+  void record_allocation(std::size_t bytes);
+  void record_deallocation(std::size_t bytes);
+  std::string describe() const;
+
+  const std::string& get_name() const;
+  std::size_t get_live_bytes() const;
+  std::size_t get_peak_bytes() const;
+  std::size_t get_allocation_count() const;
+
+private:
+  std::string name;
+  std::atomic<std::size_t> live_bytes{0};
+  std::atomic<std::size_t> peak_bytes{0};
+  std::atomic<std::size_t> allocation_count{0};
+};
+
+// Passes allocations through to another resource, recording them in an
+// account on the way
+class TrackingResource : public std::pmr::memory_resource {
+public:
+  TrackingResource(
+      MemoryAccount* account,
+      std::pmr::memory_resource* upstream = std::pmr::new_delete_resource());
+
+private:
+  MemoryAccount* account;
+  std::pmr::memory_resource* upstream;
+
+  void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+  void do_deallocate(void* block, std::size_t bytes,
+                     std::size_t alignment) override;
+  bool do_is_equal(const std::pmr::memory_resource& other) const
+      noexcept override;
+};
+
+#endif // !MEMORY_ACCOUNT_H
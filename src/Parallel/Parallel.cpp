@@ -0,0 +1,9 @@
+#include "Parallel.h"
+
+std::size_t parallel_chunk_count(std::size_t count,
+                                 std::size_t min_chunk_size) {
+  std::size_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+  std::size_t chunk_count = (count + min_chunk_size - 1) / min_chunk_size;
+
+  return std::max<std::size_t>(1, std::min(thread_count, chunk_count));
+}
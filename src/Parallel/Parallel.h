@@ -0,0 +1,41 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Ranges smaller than this are not worth the cost of spawning a thread
+#define PARALLEL_MIN_CHUNK_SIZE 4096
+
+std::size_t parallel_chunk_count(
+    std::size_t count, std::size_t min_chunk_size = PARALLEL_MIN_CHUNK_SIZE);
+
+// Splits [0, count) into parallel_chunk_count(count) contiguous chunks and
+// calls function(begin, end, chunk_index) for each of them concurrently. The
+// calling thread handles the first chunk itself.
+template <typename Function>
+void parallel_for(std::size_t count, Function&& function,
+                  std::size_t min_chunk_size = PARALLEL_MIN_CHUNK_SIZE) {
+  std::size_t chunk_count = parallel_chunk_count(count, min_chunk_size);
+  std::size_t chunk_size = (count + chunk_count - 1) / chunk_count;
+  std::vector<std::thread> workers;
+
+  for (std::size_t chunk = 1; chunk < chunk_count; chunk++) {
+    std::size_t begin = std::min(count, chunk * chunk_size);
+    std::size_t end = std::min(count, begin + chunk_size);
+
+    workers.emplace_back([&function, begin, end, chunk]() {
+      function(begin, end, chunk);
+    });
+  }
+
+  function(0, std::min(count, chunk_size), 0);
+
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+}
+
+#endif // !PARALLEL_H
@@ -0,0 +1,326 @@
+#include "Server.h"
+
+// Whether the other end of a connection runs as the current user
+static bool is_same_user(int connection_fd) {
+  struct ucred credentials;
+  socklen_t length = sizeof(credentials);
+
+  return getsockopt(connection_fd, SOL_SOCKET, SO_PEERCRED, &credentials,
+                    &length) == 0 &&
+         credentials.uid == getuid();
+}
+
+static bool make_address(const std::string& socket_path,
+                         struct sockaddr_un& address) {
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+
+  if (socket_path.length() >= sizeof(address.sun_path)) {
+    return false;
+  }
+
+  memcpy(address.sun_path, socket_path.c_str(), socket_path.length());
+  return true;
+}
+
+static bool send_all(int connection_fd, const char* data, size_t length) {
+  while (length > 0) {
+    ssize_t num_bytes_sent = send(connection_fd, data, length, MSG_NOSIGNAL);
+
+    if (num_bytes_sent == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      return false;
+    }
+
+    data += num_bytes_sent;
+    length -= num_bytes_sent;
+  }
+
+  return true;
+}
+
+static bool receive_all(int connection_fd, char* data, size_t length) {
+  while (length > 0) {
+    ssize_t num_bytes_received = recv(connection_fd, data, length, 0);
+
+    if (num_bytes_received == -1 && errno == EINTR) {
+      continue;
+    }
+
+    if (num_bytes_received <= 0) {
+      return false;
+    }
+
+    data += num_bytes_received;
+    length -= num_bytes_received;
+  }
+
+  return true;
+}
+
+std::string get_socket_path() {
+  const char* runtime_directory = getenv("XDG_RUNTIME_DIR");
+
+  if (runtime_directory != nullptr && runtime_directory[0] != '\0') {
+    return std::string{runtime_directory} + "/" + SERVER_SOCKET_NAME;
+  }
+
+  return "/tmp/kilo-" + std::to_string(getuid()) + ".sock";
+}
+
+// Hands the terminal over to a running daemon and blocks until the daemon is
+// done with it. Returns false when no daemon took the session, in which case
+// the terminal was left untouched.
+bool attach_to_server(const std::string& socket_path,
+                      const std::vector<std::string>& filenames) {
+  struct sockaddr_un address;
+
+  if (!isatty(STDIN_FILENO) || !isatty(STDOUT_FILENO) ||
+      !make_address(socket_path, address)) {
+    return false;
+  }
+
+  int connection_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+  if (connection_fd == -1) {
+    return false;
+  }
+
+  // The terminal must not be handed to a socket someone else created
+  if (connect(connection_fd, (struct sockaddr*)&address, sizeof(address)) ==
+          -1 ||
+      !is_same_user(connection_fd)) {
+    close(connection_fd);
+    return false;
+  }
+
+  char working_directory[PATH_MAX];
+
+  if (getcwd(working_directory, sizeof(working_directory)) == nullptr) {
+    close(connection_fd);
+    return false;
+  }
+
+  // The request is its length, sent along with the terminal's descriptors,
+  // followed by the working directory and the filenames, each terminated by
+  // a NUL
+  std::string request{working_directory};
+  request.push_back('\0');
+
+  for (const std::string& filename : filenames) {
+    request.append(filename);
+    request.push_back('\0');
+  }
+
+  uint32_t request_length = request.length();
+  int descriptors[2]{STDIN_FILENO, STDOUT_FILENO};
+  char control[CMSG_SPACE(sizeof(descriptors))];
+  struct iovec header{&request_length, sizeof(request_length)};
+  struct msghdr message;
+
+  memset(&message, 0, sizeof(message));
+  memset(control, 0, sizeof(control));
+  message.msg_iov = &header;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+
+  struct cmsghdr* control_message = CMSG_FIRSTHDR(&message);
+  control_message->cmsg_level = SOL_SOCKET;
+  control_message->cmsg_type = SCM_RIGHTS;
+  control_message->cmsg_len = CMSG_LEN(sizeof(descriptors));
+  memcpy(CMSG_DATA(control_message), descriptors, sizeof(descriptors));
+
+  // A busy daemon may reply and hang up before reading any of this, so
+  // failing to send is only decided by the reply
+  if (sendmsg(connection_fd, &message, MSG_NOSIGNAL) ==
+      sizeof(request_length)) {
+    send_all(connection_fd, request.data(), request.length());
+  }
+
+  char status;
+
+  if (!receive_all(connection_fd, &status, 1) ||
+      status != SERVER_STATUS_ATTACHED) {
+    close(connection_fd);
+    return false;
+  }
+
+  // The daemon closes the connection when the session ends
+  ssize_t num_bytes_received;
+
+  do {
+    num_bytes_received = recv(connection_fd, &status, 1, 0);
+  } while (num_bytes_received > 0 ||
+           (num_bytes_received == -1 && errno == EINTR));
+
+  close(connection_fd);
+  return true;
+}
+
+Server::Server(const std::string& socket_path) : socket_path(socket_path) {
+  struct sockaddr_un address;
+
+  if (!make_address(socket_path, address)) {
+    throw std::runtime_error{"Server: socket path is too long"};
+  }
+
+  listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+  if (listen_fd == -1) {
+    throw std::runtime_error{"Server: could not create socket"};
+  }
+
+  if (bind(listen_fd, (struct sockaddr*)&address, sizeof(address)) == -1) {
+    // A socket nobody listens on is left over from a daemon that was killed
+    bool is_in_use = errno == EADDRINUSE;
+    int probe_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    bool is_listening =
+        probe_fd != -1 &&
+        connect(probe_fd, (struct sockaddr*)&address, sizeof(address)) == 0;
+
+    if (probe_fd != -1) {
+      close(probe_fd);
+    }
+
+    if (!is_in_use || is_listening || unlink(socket_path.c_str()) == -1 ||
+        bind(listen_fd, (struct sockaddr*)&address, sizeof(address)) == -1) {
+      close(listen_fd);
+      throw std::runtime_error{"Server: could not listen on " + socket_path};
+    }
+  }
+
+  if (chmod(socket_path.c_str(), 0600) == -1 || listen(listen_fd, 8) == -1) {
+    close(listen_fd);
+    unlink(socket_path.c_str());
+    throw std::runtime_error{"Server: could not listen on " + socket_path};
+  }
+}
+
+Server::~Server() {
+  close(listen_fd);
+  unlink(socket_path.c_str());
+}
+
+// Blocks until a client sent a valid request, and tells it the session
+// started
+Session Server::accept() {
+  while (true) {
+    struct pollfd listener{listen_fd, POLLIN, 0};
+
+    if (poll(&listener, 1, -1) == -1 && errno != EINTR) {
+      throw std::runtime_error{"accept: could not poll for clients"};
+    }
+
+    Session session;
+    session.connection_fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+
+    if (session.connection_fd == -1) {
+      continue;
+    }
+
+    char status = SERVER_STATUS_ATTACHED;
+
+    if (read_request(session) && send_all(session.connection_fd, &status, 1)) {
+      return session;
+    }
+
+    close_session(session);
+  }
+}
+
+// Turns away the clients that connected while a session is running
+void Server::reject_pending() {
+  int connection_fd;
+
+  while ((connection_fd = accept4(listen_fd, nullptr, nullptr,
+                                  SOCK_CLOEXEC)) != -1) {
+    char status = SERVER_STATUS_BUSY;
+
+    send_all(connection_fd, &status, 1);
+    close(connection_fd);
+  }
+}
+
+void Server::close_session(Session& session) {
+  for (int* file_descriptor :
+       {&session.input_fd, &session.output_fd, &session.connection_fd}) {
+    if (*file_descriptor != -1) {
+      close(*file_descriptor);
+      *file_descriptor = -1;
+    }
+  }
+}
+
+// Becomes readable when a client is waiting
+int Server::get_notification_fd() const {
+  return listen_fd;
+}
+
+bool Server::read_request(Session& session) {
+  struct timeval timeout{SERVER_REQUEST_TIMEOUT_SECONDS, 0};
+
+  if (!is_same_user(session.connection_fd) ||
+      setsockopt(session.connection_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                 sizeof(timeout)) == -1) {
+    return false;
+  }
+
+  uint32_t request_length = 0;
+  int descriptors[2];
+  char control[CMSG_SPACE(sizeof(descriptors))];
+  struct iovec header{&request_length, sizeof(request_length)};
+  struct msghdr message;
+
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = &header;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+
+  ssize_t num_bytes_received;
+
+  do {
+    num_bytes_received =
+        recvmsg(session.connection_fd, &message, MSG_CMSG_CLOEXEC);
+  } while (num_bytes_received == -1 && errno == EINTR);
+
+  struct cmsghdr* control_message = CMSG_FIRSTHDR(&message);
+
+  if (control_message == nullptr || control_message->cmsg_level != SOL_SOCKET ||
+      control_message->cmsg_type != SCM_RIGHTS ||
+      control_message->cmsg_len != CMSG_LEN(sizeof(descriptors))) {
+    return false;
+  }
+
+  memcpy(descriptors, CMSG_DATA(control_message), sizeof(descriptors));
+  session.input_fd = descriptors[0];
+  session.output_fd = descriptors[1];
+
+  if (num_bytes_received != sizeof(request_length) || request_length == 0 ||
+      request_length > SERVER_MAX_REQUEST_SIZE ||
+      !isatty(session.input_fd) || !isatty(session.output_fd)) {
+    return false;
+  }
+
+  std::string request(request_length, '\0');
+
+  if (!receive_all(session.connection_fd, request.data(), request_length) ||
+      request.back() != '\0') {
+    return false;
+  }
+
+  std::size_t begin = request.find('\0') + 1;
+  session.working_directory = request.substr(0, begin - 1);
+
+  while (begin < request.length()) {
+    std::size_t end = request.find('\0', begin);
+    session.filenames.push_back(request.substr(begin, end - begin));
+    begin = end + 1;
+  }
+
+  return true;
+}
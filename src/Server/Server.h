@@ -0,0 +1,65 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <climits>
+#include <stdexcept>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/un.h>
+
+#define SERVER_SOCKET_NAME "kilo.sock"
+// How long a connecting client may take to send its request
+#define SERVER_REQUEST_TIMEOUT_SECONDS 2
+#define SERVER_MAX_REQUEST_SIZE (1 << 20)
+
+// Replies to a request
+#define SERVER_STATUS_ATTACHED 0
+#define SERVER_STATUS_BUSY 1
+
+// A client's terminal, attached to the editor until the session ends. The
+// editor treats the connection becoming readable as the client going away.
+struct Session {
+  int input_fd{-1};
+  int output_fd{-1};
+  int connection_fd{-1};
+  std::string working_directory;
+  std::vector<std::string> filenames;
+};
+
+std::string get_socket_path();
+bool attach_to_server(const std::string& socket_path,
+                      const std::vector<std::string>& filenames);
+
+// Listens for clients on a Unix domain socket only the current user can
+// connect to. A client sends its working directory and the files to open,
+// along with its terminal's descriptors, then waits for the connection to
+// close. One session is served at a time; clients arriving meanwhile are
+// turned away and run an editor of their own instead.
+class Server {
+public:
+  Server(const std::string& socket_path);
+  ~Server();
+
+  Session accept();
+  void reject_pending();
+  void close_session(Session& session);
+  int get_notification_fd() const;
+
+private:
+  std::string socket_path;
+  int listen_fd{-1};
+
+  bool read_request(Session& session);
+};
+
+#endif // !SERVER_H
@@ -0,0 +1,210 @@
+#include "TaskScheduler.h"
+
+// Lets submit() tell whether it is called from one of the workers
+static thread_local const TaskScheduler* current_scheduler{nullptr};
+static thread_local std::size_t current_worker{0};
+
+CancellationToken::CancellationToken() : state(std::make_shared<State>()) {}
+
+CancellationToken CancellationToken::derive() const {
+  CancellationToken token;
+  token.state->parent = state;
+  return token;
+}
+
+void CancellationToken::cancel() const {
+  state->cancelled = true;
+}
+
+bool CancellationToken::is_cancelled() const {
+  for (const State* token = state.get(); token != nullptr;
+       token = token->parent.get()) {
+    if (token->cancelled) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+TaskScheduler::TaskScheduler(std::size_t worker_count) {
+  if (pipe2(notification_pipe, O_NONBLOCK | O_CLOEXEC) == -1) {
+    throw std::runtime_error{"TaskScheduler: could not create pipe"};
+  }
+
+  if (worker_count == 0) {
+    worker_count = std::max<std::size_t>(TASK_SCHEDULER_MIN_WORKERS,
+                                         std::thread::hardware_concurrency());
+  }
+
+  for (std::size_t index = 0; index < worker_count; index++) {
+    workers.push_back(std::make_unique<Worker>());
+  }
+
+  for (std::size_t index = 0; index < worker_count; index++) {
+    workers[index]->thread = std::thread{[this, index]() {
+      run_worker(index);
+    }};
+  }
+}
+
+TaskScheduler::~TaskScheduler() {
+  shutdown();
+  close(notification_pipe[0]);
+  close(notification_pipe[1]);
+}
+
+void TaskScheduler::submit(TaskPriority priority, Task task) {
+  std::size_t index = current_scheduler == this
+                          ? current_worker
+                          : next_worker++ % workers.size();
+
+  {
+    std::lock_guard<std::mutex> lock{workers[index]->mutex};
+    workers[index]->queues[(int)priority].push_back(std::move(task));
+  }
+
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    queued_count++;
+  }
+
+  wakeup.notify_one();
+}
+
+// Waits for the workers to finish every task that was submitted, cancel the
+// ones that should not run. Completions can still be posted, and run,
+// afterwards.
+void TaskScheduler::shutdown() {
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    stopping = true;
+  }
+
+  wakeup.notify_all();
+
+  for (std::unique_ptr<Worker>& worker : workers) {
+    if (worker->thread.joinable()) {
+      worker->thread.join();
+    }
+  }
+}
+
+// Hands a completion to the UI thread, callable from any thread
+void TaskScheduler::post(Task completion) {
+  {
+    std::lock_guard<std::mutex> lock{completions_mutex};
+    completions.push_back(std::move(completion));
+  }
+
+  // A full pipe is already readable, so the byte is not needed then
+  char byte = 0;
+  if (write(notification_pipe[1], &byte, 1) == -1 && errno != EAGAIN) {
+    throw std::runtime_error{"post: could not notify the UI thread"};
+  }
+}
+
+// Runs the posted completions on the calling thread. Returns whether there
+// were any.
+bool TaskScheduler::run_completions() {
+  char bytes[64];
+  while (read(notification_pipe[0], bytes, sizeof(bytes)) > 0) {
+  }
+
+  std::vector<Task> pending;
+
+  {
+    std::lock_guard<std::mutex> lock{completions_mutex};
+    pending.swap(completions);
+  }
+
+  // Each completion is destroyed right after it ran, along with whatever it
+  // captured
+  for (Task& completion : pending) {
+    Task current = std::move(completion);
+    current();
+  }
+
+  return !pending.empty();
+}
+
+// Blocks until at least one completion was posted, then runs them
+void TaskScheduler::wait_for_completions() {
+  struct pollfd notification{notification_pipe[0], POLLIN, 0};
+
+  while (!run_completions()) {
+    if (poll(&notification, 1, -1) == -1 && errno != EINTR) {
+      throw std::runtime_error{
+          "wait_for_completions: could not poll for completions"};
+    }
+  }
+}
+
+int TaskScheduler::get_notification_fd() const {
+  return notification_pipe[0];
+}
+
+std::size_t TaskScheduler::get_worker_count() const {
+  return workers.size();
+}
+
+void TaskScheduler::run_worker(std::size_t index) {
+  current_scheduler = this;
+  current_worker = index;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock{mutex};
+      wakeup.wait(lock, [&]() { return queued_count > 0 || stopping; });
+
+      // Only stop once the queues are drained
+      if (queued_count == 0) {
+        return;
+      }
+
+      // Claims one of the queued tasks, so the search below cannot come up
+      // empty for good
+      queued_count--;
+    }
+
+    Task task;
+
+    while (!take_task(index, task)) {
+      std::this_thread::yield();
+    }
+
+    try {
+      task();
+    } catch (...) {
+      // Tasks report their own errors through completions
+    }
+  }
+}
+
+// Takes the newest task of the worker's own queue, or steals the oldest one
+// of another worker, from the highest priority that has any
+bool TaskScheduler::take_task(std::size_t index, Task& task) {
+  for (int priority = 0; priority < TASK_PRIORITY_COUNT; priority++) {
+    for (std::size_t offset = 0; offset < workers.size(); offset++) {
+      Worker& worker = *workers[(index + offset) % workers.size()];
+      std::lock_guard<std::mutex> lock{worker.mutex};
+      std::deque<Task>& queue = worker.queues[priority];
+
+      if (queue.empty()) {
+        continue;
+      }
+
+      if (offset == 0) {
+        task = std::move(queue.back());
+        queue.pop_back();
+      } else {
+        task = std::move(queue.front());
+        queue.pop_front();
+      }
+
+      return true;
+    }
+  }
+
+  return false;
+}
@@ -0,0 +1,94 @@
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdexcept>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+
+// The scheduler keeps this many workers even on a single core, so one long
+// task cannot hold up everything else
+#define TASK_SCHEDULER_MIN_WORKERS 2
+#define TASK_PRIORITY_COUNT 3
+
+// Queued tasks run strictly in this order
+enum class TaskPriority {
+  Viewport,    // Needed to draw what is on screen
+  Interactive, // Started by the user, who is waiting for the result
+  Background,  // Nobody is waiting for it
+};
+
+typedef std::function<void()> Task;
+
+// Tasks are never interrupted, they poll their token and stop early once it
+// is cancelled. Cancelling a token cancels every token derived from it too.
+class CancellationToken {
+public:
+  CancellationToken();
+
+  CancellationToken derive() const;
+  void cancel() const;
+  bool is_cancelled() const;
+
+private:
+  struct State {
+    std::atomic<bool> cancelled{false};
+    std::shared_ptr<State> parent;
+  };
+
+  std::shared_ptr<State> state;
+};
+
+// A work-stealing pool. Every worker has a queue per priority; tasks
+// submitted by a worker go to its own queue, others are spread round-robin,
+// and an idle worker steals the oldest task of the highest priority it can
+// find. Results go back to the UI thread as completions, which are run by
+// run_completions(); get_notification_fd() becomes readable when there are
+// any.
+class TaskScheduler {
+public:
+  TaskScheduler(std::size_t worker_count = 0);
+  ~TaskScheduler();
+
+  void submit(TaskPriority priority, Task task);
+  void shutdown();
+  void post(Task completion);
+  bool run_completions();
+  void wait_for_completions();
+
+  int get_notification_fd() const;
+  std::size_t get_worker_count() const;
+
+private:
+  struct Worker {
+    std::mutex mutex;
+    std::deque<Task> queues[TASK_PRIORITY_COUNT];
+    std::thread thread;
+  };
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::mutex mutex;
+  std::condition_variable wakeup;
+  std::size_t queued_count{0};
+  bool stopping{false};
+  std::atomic<std::size_t> next_worker{0};
+
+  std::mutex completions_mutex;
+  std::vector<Task> completions;
+  int notification_pipe[2]{-1, -1};
+
+  void run_worker(std::size_t index);
+  bool take_task(std::size_t index, Task& task);
+};
+
+#endif // !TASK_SCHEDULER_H
@@ -1,6 +1,6 @@
 #include "Terminal.h"
 
-Terminal::Terminal() {
+Terminal::Terminal(int file_descriptor) : file_descriptor(file_descriptor) {
   enable_raw_mode();
 }
 
@@ -9,8 +9,9 @@ Terminal::~Terminal() {
 }
 
 void Terminal::enable_raw_mode() {
-  if (tcgetattr(STDIN_FILENO, &termios) == -1) {
-    terminate("tcgetattr");
+  if (tcgetattr(file_descriptor, &termios) == -1) {
+    throw std::runtime_error{"enable_raw_mode: could not get terminal "
+                             "attributes"};
   }
 
   struct termios raw = termios;
@@ -21,21 +22,13 @@ void Terminal::enable_raw_mode() {
   raw.c_cc[VMIN] = 0;
   raw.c_cc[VTIME] = 1;
 
-  if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1) {
-    terminate("tcsetattr");
+  if (tcsetattr(file_descriptor, TCSAFLUSH, &raw) == -1) {
+    throw std::runtime_error{"enable_raw_mode: could not set terminal "
+                             "attributes"};
   }
 }
 
+// Best effort, the terminal may already be gone
 void Terminal::disable_raw_mode() {
-  if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &termios) == -1) {
-    terminate("tcsetattr");
-  }
-}
-
-void Terminal::terminate(const std::string& reason) {
-  write(STDOUT_FILENO, "\x1b[2J", 4);
-  write(STDOUT_FILENO, "\x1b[H", 3);
-
-  perror(reason.c_str());
-  exit(1);
+  tcsetattr(file_descriptor, TCSAFLUSH, &termios);
 }
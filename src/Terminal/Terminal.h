@@ -6,20 +6,22 @@
 #include <unistd.h>
 #include <cstdlib>
 #include <string>
+#include <stdexcept>
 #include <ctype.h>
 #include <errno.h>
 
+// Keeps a terminal in raw mode for as long as it exists
 class Terminal {
 public:
-  Terminal();
+  Terminal(int file_descriptor);
   ~Terminal();
-  void terminate(const std::string& reason);
-  void disable_raw_mode();
 
 private:
+  int file_descriptor;
   struct termios termios;
 
   void enable_raw_mode();
+  void disable_raw_mode();
 };
 
 #endif // !TERMINAL_H
@@ -1,9 +1,47 @@
 #include "Editor/Editor.h"
 
+// Keeps buffers resident in the background and serves the clients that
+// attach to it, until a session shuts it down
+static int run_daemon() {
+  try {
+    Server server{get_socket_path()};
+
+    // Before the editor starts any threads, which would not survive the fork
+    if (daemon(1, 0) == -1) {
+      throw std::runtime_error{"daemon: could not detach from the terminal"};
+    }
+
+    Editor editor{&server};
+    bool keep_serving = true;
+
+    while (keep_serving) {
+      Session session = server.accept();
+
+      keep_serving = editor.attach(session);
+      server.close_session(session);
+    }
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
 int main(int argc, char* argv[]) {
+  std::vector<std::string> arguments{argv + 1, argv + argc};
+
+  if (arguments.size() == 1 && arguments.front() == "--daemon") {
+    return run_daemon();
+  }
+
+  // A running daemon already has the files, or can open them much faster
+  if (attach_to_server(get_socket_path(), arguments)) {
+    return 0;
+  }
 
-  std::string filename{argc >= 2 ? argv[1] : ""};
-  Editor editor{filename};
+  Editor editor;
+  editor.attach(Session{STDIN_FILENO, STDOUT_FILENO, -1, "", arguments});
 
   return 0;
 }